@@ -0,0 +1,977 @@
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <vector>
+#include <map>
+#include <set>
+#include <functional>
+#include <algorithm>
+#include <cstdint>
+using namespace std;
+
+#include "isa.h"      // mnemonics & cycles
+
+/* A tiny language compiled into the assembly of parser.cpp:
+
+     x = 15                  # bytes, modulo 256
+     y = 15
+     res = 0
+     while y != 0 {
+       res = res + x * 2
+       y = y - 1
+     }
+     out res                 # HLT at the end
+
+   Expressions: numbers, variables, + - * and ( ). Conditions:
+   == != < <= > >= (unsigned) or an expression (not 0).
+   Statements: assignments, out, halt, while & if/else.
+
+   Where there are several ways to compute the same thing, the
+   one taking the fewest cycles (isa.h) is written, and A is
+   followed so variables already in it are not loaded again. */
+
+//////////////////////////////////////////////////////////////////////////////////////////////
+//                                       SYNTAX TREE
+//////////////////////////////////////////////////////////////////////////////////////////////
+
+const int NODE_NUMBER   = 0;
+const int NODE_VARIABLE = 1;
+const int NODE_BINARY   = 2;
+
+struct Node {
+  int    kind;
+  int    value;                 // of a number, 0 to 255
+  string name;                  // of a variable
+  char   op;                    // +, - or * of a binary node
+  int    left;                  // node indices
+  int    right;
+};
+
+/* "a > b" is kept as "b < a" & "a <= b" as "b >= a", so
+   every condition is on the flags of a single difference */
+struct Condition {
+  string op;                    // ==, !=, < or >=
+  int    difference;            // node of "left - right"
+  int    constant;              // 0 or 1 when known while compiling, -1 otherwise
+};
+
+const int STATEMENT_ASSIGN = 0;
+const int STATEMENT_OUT    = 1;
+const int STATEMENT_HALT   = 2;
+const int STATEMENT_WHILE  = 3;
+const int STATEMENT_IF     = 4;
+
+struct Statement {
+  int         kind;
+  int         line;
+  bool        isFirstOnLine;    // gets the line as a comment
+  string      name;             // of an assignment
+  int         expression;       // of an assignment or out
+  Condition   condition;        // of while & if
+  vector<int> body;             // statement indices
+  vector<int> elseBody;
+};
+
+vector<Node>      Nodes;
+vector<Statement> Statements;
+vector<string>    SourceLines;
+bool              ExtendedISA = false;   // short forms cost less
+
+//////////////////////////////////////////////////////////////////////////////////////////////
+//                                     PARSING FUNCTIONS
+//////////////////////////////////////////////////////////////////////////////////////////////
+
+vector<string> Tokens;
+vector<int>    TokenLines;
+unsigned int   iToken = 0;
+int            LastStatementLine = 0;
+
+inline bool isNameStart(char c) {
+  return isalpha(c) || c == '_';
+}
+
+bool tokenize(string source) {
+  int line = 1;
+  for (unsigned int i = 0; i < source.length(); ) {
+    char c = source[i];
+    if (c == '\n')
+      line++;
+    if (isspace(c)) {
+      i++;
+      continue;
+    }
+    if (c == '#') {
+      while (i < source.length() && source[i] != '\n')
+        i++;
+      continue;
+    }
+
+    unsigned int start = i;
+    if (isNameStart(c) || isdigit(c)) {
+      while (i < source.length() && (isalnum(source[i]) || source[i] == '_'))
+        i++;
+    }
+    else if (source.compare(i, 2, "==") == 0 || source.compare(i, 2, "!=") == 0
+             || source.compare(i, 2, "<=") == 0 || source.compare(i, 2, ">=") == 0)
+      i += 2;
+    else if (string("=<>+-*(){}").find(c) != string::npos)
+      i++;
+    else {
+      cout << "[error] Line " << line << ": character '" << c << "' is not allowed." << endl;
+      return false;
+    }
+    Tokens.push_back(source.substr(start, i - start));
+    TokenLines.push_back(line);
+  }
+  return true;
+}
+
+inline string peekToken() {
+  return iToken < Tokens.size() ? Tokens[iToken] : "";
+}
+
+bool syntaxError(string message) {
+  int line = TokenLines.empty() ? 1 : TokenLines[min((unsigned int)TokenLines.size() - 1, iToken)];
+  cout << "[error] Line " << line << ": " << message << endl;
+  return false;
+}
+
+bool expectToken(string token) {
+  if (peekToken() != token)
+    return syntaxError("\"" + token + "\" expected" + (peekToken() != "" ? " before \"" + peekToken() + "\"." : " at the end."));
+  iToken++;
+  return true;
+}
+
+// Decimal, 0x.. hex or 0b.. binary
+bool parseNumber(string text, int& number) {
+  int base = 10;
+  if (text.length() > 2 && text[0] == '0' && (text[1] == 'x' || text[1] == 'b')) {
+    base = (text[1] == 'x') ? 16 : 2;
+    text = text.substr(2);
+  }
+
+  number = 0;
+  for (unsigned int i = 0; i < text.length(); ++i) {
+    int digit = isdigit(text[i]) ? text[i] - '0' : (isxdigit(text[i]) ? tolower(text[i]) - 'a' + 10 : base);
+    if (digit >= base)
+      return false;
+    number = number * base + digit;
+    if (number > 255)
+      return false;
+  }
+  return true;
+}
+
+bool isKeyword(string name) {
+  return name == "while" || name == "if" || name == "else" || name == "out" || name == "halt";
+}
+
+// Names starting with "_" are for the compiler, mnemonics
+// would read like instructions in the assembly.
+bool isGoodName(string name) {
+  if (!isNameStart(name[0]) || name[0] == '_' || isKeyword(name))
+    return false;
+  for (int i = 0; i < INSTRUCTION_COUNT; ++i) {
+    string mnemonic = Instructions[i].mnemonic;
+    if (name.length() == mnemonic.length() && equal(name.begin(), name.end(), mnemonic.begin(),
+                                                    [](char a, char b) { return toupper(a) == b; }))
+      return false;
+  }
+  return true;
+}
+
+int makeNumber(int value) {
+  Nodes.push_back({ NODE_NUMBER, value & 0xff, "", 0, -1, -1 });
+  return Nodes.size() - 1;
+}
+
+// Folds numbers & drops "+ 0", "- 0", "* 1" & "* 0"
+int makeBinary(char op, int left, int right) {
+  bool isLeftNumber  = Nodes[left].kind == NODE_NUMBER;
+  bool isRightNumber = Nodes[right].kind == NODE_NUMBER;
+  int  leftValue     = Nodes[left].value;
+  int  rightValue    = Nodes[right].value;
+
+  if (isLeftNumber && isRightNumber)
+    return makeNumber(op == '+' ? leftValue + rightValue : (op == '-' ? leftValue - rightValue : leftValue * rightValue));
+  if (isRightNumber && rightValue == 0 && op != '*')
+    return left;
+  if (isLeftNumber && leftValue == 0 && op == '+')
+    return right;
+  if (op == '*' && ((isLeftNumber && leftValue == 0) || (isRightNumber && rightValue == 0)))
+    return makeNumber(0);
+  if (op == '*' && isRightNumber && rightValue == 1)
+    return left;
+  if (op == '*' && isLeftNumber && leftValue == 1)
+    return right;
+
+  Nodes.push_back({ NODE_BINARY, 0, "", op, left, right });
+  return Nodes.size() - 1;
+}
+
+bool parseExpression(int& node);
+
+bool parseFactor(int& node) {
+  string token = peekToken();
+  if (token == "")
+    return syntaxError("Expression expected at the end.");
+  iToken++;
+
+  if (token == "(")
+    return parseExpression(node) && expectToken(")");
+
+  if (token == "-") {
+    int operand;
+    if (!parseFactor(operand))
+      return false;
+    node = makeBinary('-', makeNumber(0), operand);
+    return true;
+  }
+
+  int value;
+  if (isdigit(token[0])) {
+    if (!parseNumber(token, value)) {
+      iToken--;
+      return syntaxError("\"" + token + "\" should be a number from 0 to 255.");
+    }
+    node = makeNumber(value);
+    return true;
+  }
+
+  if (!isGoodName(token)) {
+    iToken--;
+    return syntaxError("\"" + token + "\" cannot be a variable.");
+  }
+  Nodes.push_back({ NODE_VARIABLE, 0, token, 0, -1, -1 });
+  node = Nodes.size() - 1;
+  return true;
+}
+
+bool parseTerm(int& node) {
+  if (!parseFactor(node))
+    return false;
+  while (peekToken() == "*") {
+    iToken++;
+    int right;
+    if (!parseFactor(right))
+      return false;
+    node = makeBinary('*', node, right);
+  }
+  return true;
+}
+
+bool parseExpression(int& node) {
+  if (!parseTerm(node))
+    return false;
+  while (peekToken() == "+" || peekToken() == "-") {
+    char op = Tokens[iToken++][0];
+    int  right;
+    if (!parseTerm(right))
+      return false;
+    node = makeBinary(op, node, right);
+  }
+  return true;
+}
+
+bool parseCondition(Condition& condition) {
+  int left, right;
+  if (!parseExpression(left))
+    return false;
+
+  string op = peekToken();
+  if (op == "==" || op == "!=" || op == "<" || op == "<=" || op == ">" || op == ">=") {
+    iToken++;
+    if (!parseExpression(right))
+      return false;
+  }
+  else {
+    op    = "!=";
+    right = makeNumber(0);
+  }
+
+  if (op == ">" || op == "<=") {
+    swap(left, right);
+    op = (op == ">") ? "<" : ">=";
+  }
+  condition.op         = op;
+  condition.difference = makeBinary('-', left, right);
+  condition.constant   = -1;
+
+  // Nothing is below 0, & "x - 0" is folded into x, whose flags say nothing of a borrow
+  const Node& difference = Nodes[condition.difference];
+  bool        isBorrow   = (op == "<" || op == ">=");
+  if (isBorrow && Nodes[right].kind == NODE_NUMBER && Nodes[right].value == 0)
+    condition.constant = (op == ">=");
+  else if (Nodes[left].kind == NODE_NUMBER && Nodes[right].kind == NODE_NUMBER) {
+    bool isEqual = (difference.value == 0);
+    bool isBelow = (Nodes[left].value < Nodes[right].value);
+    condition.constant = (op == "==") ? isEqual : (op == "!=") ? !isEqual : (op == "<") ? isBelow : !isBelow;
+  }
+  return true;
+}
+
+bool parseStatement(int& statement);
+
+bool parseBlock(vector<int>& body) {
+  if (!expectToken("{"))
+    return false;
+  while (peekToken() != "}") {
+    if (peekToken() == "")
+      return expectToken("}");
+    int statement;
+    if (!parseStatement(statement))
+      return false;
+    body.push_back(statement);
+  }
+  iToken++;
+  return true;
+}
+
+bool parseStatement(int& statement) {
+  Statement parsed;
+  string    token = peekToken();
+  parsed.line          = TokenLines[iToken++];
+  parsed.isFirstOnLine = parsed.line != LastStatementLine;
+  LastStatementLine    = parsed.line;
+  parsed.expression    = -1;
+
+  if (token == "out") {
+    parsed.kind = STATEMENT_OUT;
+    if (!parseExpression(parsed.expression))
+      return false;
+  }
+  else if (token == "halt")
+    parsed.kind = STATEMENT_HALT;
+  else if (token == "while" || token == "if") {
+    parsed.kind = (token == "while") ? STATEMENT_WHILE : STATEMENT_IF;
+    if (!parseCondition(parsed.condition) || !parseBlock(parsed.body))
+      return false;
+    if (token == "if" && peekToken() == "else") {
+      iToken++;
+      if (!parseBlock(parsed.elseBody))
+        return false;
+    }
+  }
+  else if (isGoodName(token)) {
+    parsed.kind = STATEMENT_ASSIGN;
+    parsed.name = token;
+    if (!expectToken("=") || !parseExpression(parsed.expression))
+      return false;
+  }
+  else {
+    iToken--;
+    bool isName = isNameStart(token[0]) && token != "else" && token != "{" && token != "}";
+    return syntaxError("\"" + token + (isName ? "\" cannot be a variable." : "\" does not start a statement."));
+  }
+
+  Statements.push_back(parsed);
+  statement = Statements.size() - 1;
+  return true;
+}
+
+bool parseProgram(string source, vector<int>& program) {
+  stringstream lines(source);
+  string       line;
+  while (getline(lines, line))
+    SourceLines.push_back(line);
+
+  if (!tokenize(source))
+    return false;
+  while (iToken < Tokens.size()) {
+    int statement;
+    if (!parseStatement(statement))
+      return false;
+    program.push_back(statement);
+  }
+  return true;
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////
+//                                    GENERATING FUNCTIONS
+//////////////////////////////////////////////////////////////////////////////////////////////
+
+/* What is known of A at a point of the code */
+struct RegisterState {
+  set<string> holds;            // variables A is equal to
+  bool        hasFlags = false; // ZF (& CF) were set computing A
+};
+
+struct Code {
+  string    text;
+  long long cycles = 0;         // straight through, jumps taken
+};
+
+typedef function<void(Code&, RegisterState&)> Generator;
+
+int LabelCount = 0;
+int TempCount  = 0;             // temporaries in use, "_t0" to "_t<count - 1>"
+
+string makeLabel(string kind) {
+  return "_" + kind + "_" + to_string(LabelCount++);
+}
+
+string makeTemp() {
+  return "_t" + to_string(TempCount++);
+}
+
+inline bool isNumberOperand(string operand) {
+  return operand != "" && isdigit(operand[0]);
+}
+
+long long getCycles(int opcode, string operand = "") {
+  if (ExtendedISA && isNumberOperand(operand) && canBeShort(opcode, stoi(operand)))
+    return getInstructionCycles(opcode | stoi(operand), true, true);
+  return getInstructionCycles(opcode, true, ExtendedISA);
+}
+
+void emit(Code& code, RegisterState& state, int opcode, string operand = "") {
+  code.text   += "  " + string(getMnemonic(opcode)) + (operand != "" ? " " + operand : "") + "\n";
+  code.cycles += getCycles(opcode, operand);
+
+  switch (opcode) {
+    case LDA:
+      state.holds    = { operand };
+      state.hasFlags = false;
+      break;
+
+    case LDI:
+      state.holds.clear();
+      state.hasFlags = false;
+      break;
+
+    case STA:
+      state.holds.insert(operand);
+      break;
+
+    case AEI:
+    case SEI:
+      if (operand != "0")       // only sets the flags
+        state.holds.clear();
+      state.hasFlags = true;
+      break;
+
+    case ADD:
+    case SUB:
+    case SHL:
+    case SLF:
+      state.holds.clear();
+      state.hasFlags = true;
+      break;
+  }
+}
+
+// Paths join there, so only what they all know is kept.
+void emitLabel(Code& code, string label) {
+  code.text += label + ":\n";
+}
+
+void emitCode(Code& code, const Code& part) {
+  code.text   += part.text;
+  code.cycles += part.cycles;
+}
+
+RegisterState joinStates(const RegisterState& a, const RegisterState& b) {
+  RegisterState joined;
+  set_intersection(a.holds.begin(), a.holds.end(), b.holds.begin(), b.holds.end(),
+                   inserter(joined.holds, joined.holds.begin()));
+  joined.hasFlags = a.hasFlags && b.hasFlags;
+  return joined;
+}
+
+// Tries every way from <state> & keeps the one with the fewest cycles.
+void generateCheapest(const vector<Generator>& ways, Code& code, RegisterState& state) {
+  Code          best;
+  RegisterState bestState;
+  for (unsigned int i = 0; i < ways.size(); ++i) {
+    Code          candidate;
+    RegisterState candidateState = state;
+    ways[i](candidate, candidateState);
+    if (i == 0 || candidate.cycles < best.cycles) {
+      best      = candidate;
+      bestState = candidateState;
+    }
+  }
+  emitCode(code, best);
+  state = bestState;
+}
+
+void generateExpression(int node, Code& code, RegisterState& state);
+
+inline bool isLeaf(int node) {
+  return Nodes[node].kind != NODE_BINARY;
+}
+
+// A op= <node>, a number or a variable
+void emitOperation(char op, int node, Code& code, RegisterState& state) {
+  const Node& operand = Nodes[node];
+  if (operand.kind == NODE_NUMBER)
+    emit(code, state, op == '+' ? AEI : SEI, to_string(operand.value));
+  else
+    emit(code, state, op == '+' ? ADD : SUB, operand.name);
+}
+
+// A = 2 * <variable>
+void emitDouble(string variable, Code& code, RegisterState& state) {
+  if (state.holds.count(variable) > 0) {
+    emit(code, state, SLF);
+    return;
+  }
+  generateCheapest({
+    [&](Code& code, RegisterState& state) { emit(code, state, SHL, variable); },
+    [&](Code& code, RegisterState& state) { emit(code, state, LDA, variable); emit(code, state, SLF); }
+  }, code, state);
+}
+
+// The variable holding <node>, a temporary when it is no variable
+string generateInMemory(int node, Code& code, RegisterState& state) {
+  if (Nodes[node].kind == NODE_VARIABLE)
+    return Nodes[node].name;
+
+  generateExpression(node, code, state);
+  string temp = makeTemp();
+  emit(code, state, STA, temp);
+  return temp;
+}
+
+// Digits of <value> from the highest, 0 or 1
+vector<int> getBinaryDigits(int value) {
+  vector<int> digits;
+  for (; value > 0; value >>= 1)
+    digits.insert(digits.begin(), value & 1);
+  return digits;
+}
+
+// Digits of <value> from the highest, -1, 0 or 1 & never two
+// non-zero ones in a row (non-adjacent form): 7 is 8 - 1.
+vector<int> getSignedDigits(int value) {
+  vector<int> digits;
+  for (; value > 0; value >>= 1) {
+    int digit = 0;
+    if (value & 1) {
+      digit  = 2 - (value & 3);
+      value -= digit;
+    }
+    digits.insert(digits.begin(), digit);
+  }
+  return digits;
+}
+
+/* A = <node> * <factor>, by doubling & adding (or subtracting) the
+   operand digit after digit, in whichever digits cost less. */
+void generateConstantProduct(int node, int factor, Code& code, RegisterState& state) {
+  int    temps    = TempCount;
+  string variable = generateInMemory(node, code, state);
+
+  vector<Generator> ways;
+  vector<int>       choices[] = { getBinaryDigits(factor), getSignedDigits(factor) };
+  for (const vector<int>& digits : choices) {
+    ways.push_back([&, digits](Code& code, RegisterState& state) {
+      emitDouble(variable, code, state);
+      for (unsigned int i = 1; i < digits.size(); ++i) {
+        if (i > 1)
+          emit(code, state, SLF);
+        if (digits[i] != 0)
+          emit(code, state, digits[i] > 0 ? ADD : SUB, variable);
+      }
+    });
+  }
+  generateCheapest(ways, code, state);
+  TempCount = temps;
+}
+
+/* A = <left> * <right>: the product is doubled for each of the 8
+   bits of <left>, from the highest, adding <right> when it is 1. */
+void generateProduct(int left, int right, Code& code, RegisterState& state) {
+  int    temps      = TempCount;
+  string multiplier = makeTemp();
+  string product    = makeTemp();
+  string count      = makeTemp();
+  string label      = makeLabel("mul");
+  string factor     = generateInMemory(right, code, state);
+
+  generateExpression(left, code, state);
+  emit(code, state, STA, multiplier);
+  emit(code, state, LDI, "0");
+  emit(code, state, STA, product);
+  emit(code, state, LDI, "8");
+  emit(code, state, STA, count);
+
+  emitLabel(code, label);
+  state = RegisterState();
+  emitDouble(product, code, state);
+  emit(code, state, STA, product);
+  emitDouble(multiplier, code, state);
+  emit(code, state, STA, multiplier);
+  emit(code, state, JC, label + "_add");
+
+  emitLabel(code, label + "_next");
+  state = RegisterState();
+  emit(code, state, LDA, count);
+  emit(code, state, SEI, "1");
+  emit(code, state, STA, count);
+  emit(code, state, JZ, label + "_end");
+  emit(code, state, JMP, label);
+
+  emitLabel(code, label + "_add");
+  state = RegisterState();
+  emit(code, state, LDA, product);
+  emit(code, state, ADD, factor);
+  emit(code, state, STA, product);
+  emit(code, state, JMP, label + "_next");
+
+  emitLabel(code, label + "_end");
+  state = RegisterState();
+  emit(code, state, LDA, product);
+  TempCount = temps;
+}
+
+// A = <node>
+void generateExpression(int node, Code& code, RegisterState& state) {
+  const Node& expression = Nodes[node];
+  if (expression.kind == NODE_NUMBER) {
+    emit(code, state, LDI, to_string(expression.value));
+    return;
+  }
+  if (expression.kind == NODE_VARIABLE) {
+    if (state.holds.count(expression.name) == 0)
+      emit(code, state, LDA, expression.name);
+    return;
+  }
+
+  int left  = expression.left;
+  int right = expression.right;
+  if (expression.op == '*') {
+    if (Nodes[right].kind == NODE_NUMBER)
+      generateConstantProduct(left, Nodes[right].value, code, state);
+    else if (Nodes[left].kind == NODE_NUMBER)
+      generateConstantProduct(right, Nodes[left].value, code, state);
+    else
+      generateProduct(left, right, code, state);
+    return;
+  }
+
+  // x + x is 2 * x
+  if (expression.op == '+' && Nodes[left].kind == NODE_VARIABLE && Nodes[right].kind == NODE_VARIABLE
+      && Nodes[left].name == Nodes[right].name) {
+    generateConstantProduct(left, 2, code, state);
+    return;
+  }
+
+  // The operand of ADD, SUB, AEI or SEI has to be in memory or a number
+  if (expression.op == '+' && !isLeaf(right) && isLeaf(left))
+    swap(left, right);
+  if (isLeaf(right)) {
+    generateExpression(left, code, state);
+    emitOperation(expression.op, right, code, state);
+    return;
+  }
+
+  int    temps = TempCount;
+  string temp  = generateInMemory(right, code, state);
+  generateExpression(left, code, state);
+  emit(code, state, expression.op == '+' ? ADD : SUB, temp);
+  TempCount = temps;
+}
+
+/* Jumps to <target> when <condition> is <isTrue>. "==" & "<" are
+   ZF & CF set after the difference, "!=" & ">=" the same flags
+   clear, which takes a JZ or JC over a JMP. */
+void generateJump(const Condition& condition, bool isTrue, string target, Code& code, RegisterState& state) {
+  if (condition.constant >= 0) {
+    if (condition.constant == isTrue)
+      emit(code, state, JMP, target);
+    return;
+  }
+
+  generateExpression(condition.difference, code, state);
+  if (!state.hasFlags)
+    emit(code, state, AEI, "0");
+
+  int  jump    = (condition.op == "==" || condition.op == "!=") ? JZ : JC;
+  bool isOnSet = (condition.op == "==" || condition.op == "<") == isTrue;
+  if (isOnSet) {
+    emit(code, state, jump, target);
+    return;
+  }
+
+  string skip = makeLabel("skip");
+  emit(code, state, jump, skip);
+  emit(code, state, JMP, target);
+  emitLabel(code, skip);
+}
+
+void generateStatement(int iStatement, Code& code, RegisterState& state);
+
+void generateBlock(const vector<int>& body, Code& code, RegisterState& state) {
+  for (unsigned int i = 0; i < body.size(); ++i)
+    generateStatement(body[i], code, state);
+}
+
+/* Tested at the top with a JMP back, or tested before the loop &
+   again at the bottom (where what the body leaves in A & the flags
+   can be used), whichever makes an iteration cheaper. */
+void generateWhile(const Statement& statement, Code& code, RegisterState& state) {
+  Code          top, bottom;
+  RegisterState topState    = RegisterState();
+  RegisterState bottomState = state;
+  string        topLabel    = makeLabel("while");
+  string        topEnd      = topLabel + "_end";
+  string        bottomLabel = makeLabel("while");
+  string        bottomEnd   = bottomLabel + "_end";
+
+  emitLabel(top, topLabel);
+  generateJump(statement.condition, false, topEnd, top, topState);
+  RegisterState topExit = topState;
+  generateBlock(statement.body, top, topState);
+  emit(top, topState, JMP, topLabel);
+  emitLabel(top, topEnd);
+  long long topCycles = top.cycles;
+
+  Code entry;
+  generateJump(statement.condition, false, bottomEnd, entry, bottomState);
+  RegisterState bottomExit = bottomState;
+  emitLabel(bottom, bottomLabel);
+  bottomState = RegisterState();
+  generateBlock(statement.body, bottom, bottomState);
+  generateJump(statement.condition, true, bottomLabel, bottom, bottomState);
+  emitLabel(bottom, bottomEnd);
+  long long bottomCycles = bottom.cycles;
+
+  if (topCycles <= bottomCycles) {
+    emitCode(code, top);
+    state = topExit;
+  }
+  else {
+    emitCode(code, entry);
+    emitCode(code, bottom);
+    state = joinStates(bottomExit, bottomState);
+  }
+}
+
+/* <first> runs when <condition> is <isTrue>, jumped over to <second>
+   otherwise, then <second> jumps over <first> if there is one. */
+void generateBranches(const Condition& condition, bool isTrue, const vector<int>& first, const vector<int>& second,
+                      Code& code, RegisterState& state) {
+  string secondLabel = makeLabel("else");
+  string endLabel    = makeLabel("endif");
+
+  generateJump(condition, !isTrue, secondLabel, code, state);
+  RegisterState secondState = state;
+  generateBlock(first, code, state);
+  if (second.empty()) {
+    emitLabel(code, secondLabel);
+    state = joinStates(state, secondState);
+    return;
+  }
+
+  emit(code, state, JMP, endLabel);
+  RegisterState firstState = state;
+  emitLabel(code, secondLabel);
+  generateBlock(second, code, secondState);
+  emitLabel(code, endLabel);
+  state = joinStates(firstState, secondState);
+}
+
+// With an else, the blocks can be swapped when jumping to the
+// else is the one that takes a JZ or JC over a JMP.
+void generateIf(const Statement& statement, Code& code, RegisterState& state) {
+  if (statement.elseBody.empty()) {
+    generateBranches(statement.condition, true, statement.body, statement.elseBody, code, state);
+    return;
+  }
+
+  generateCheapest({
+    [&](Code& code, RegisterState& state) {
+      generateBranches(statement.condition, true, statement.body, statement.elseBody, code, state);
+    },
+    [&](Code& code, RegisterState& state) {
+      generateBranches(statement.condition, false, statement.elseBody, statement.body, code, state);
+    }
+  }, code, state);
+}
+
+void generateStatement(int iStatement, Code& code, RegisterState& state) {
+  const Statement& statement = Statements[iStatement];
+  if (statement.isFirstOnLine) {
+    string line = SourceLines[statement.line - 1];
+    line.erase(0, line.find_first_not_of(" \t"));
+    code.text += "  # " + line.substr(0, line.find_last_not_of(" \t\r") + 1) + "\n";
+  }
+
+  switch (statement.kind) {
+    case STATEMENT_ASSIGN:
+      if (Nodes[statement.expression].kind == NODE_VARIABLE && Nodes[statement.expression].name == statement.name)
+        break;
+      generateExpression(statement.expression, code, state);
+      emit(code, state, STA, statement.name);
+      break;
+
+    case STATEMENT_OUT:
+      generateExpression(statement.expression, code, state);
+      emit(code, state, _OUT);
+      break;
+
+    case STATEMENT_HALT:
+      emit(code, state, HLT);
+      break;
+
+    case STATEMENT_WHILE:
+      generateWhile(statement, code, state);
+      break;
+
+    case STATEMENT_IF:
+      generateIf(statement, code, state);
+      break;
+  }
+}
+
+// Opcode of a mnemonic the generator wrote, -1 if none.
+int findOpcode(string mnemonic) {
+  for (int opcode = 0; opcode < 256; opcode += 0x10)
+    if (isKnownOpcode(opcode) && mnemonic == getMnemonic(opcode))
+      return opcode;
+  return -1;
+}
+
+/* Bytes the assembled program takes: its code, then one byte per
+   variable. Numbers from 1 to 15 make short forms in the extended
+   ISA, & so do tags placed there, which the assembler finds by
+   shrinking from long forms until nothing changes (tags only move
+   down, so a short form stays short). */
+int countProgramBytes(string text) {
+  vector<int>       opcodes;
+  vector<string>    operands;
+  vector<string>    labels;        // of the instruction after them
+  map<string, int>  addresses;
+  set<string>       variables;
+  stringstream      lines(text);
+  string            line;
+  string            pending;
+
+  while (getline(lines, line)) {
+    line = line.substr(0, line.find('#'));
+    if (line.find_first_not_of(' ') == string::npos)
+      continue;
+    if (line.back() == ':') {
+      labels.push_back(line.substr(0, line.length() - 1));
+      addresses[labels.back()] = 0;
+      continue;
+    }
+    stringstream words(line);
+    string       mnemonic, operand;
+    words >> mnemonic >> operand;
+    opcodes.push_back(findOpcode(mnemonic));
+    operands.push_back(operand);
+    labels.push_back("");
+  }
+
+  for (unsigned int i = 0; i < operands.size(); ++i)
+    if (operands[i] != "" && !isNumberOperand(operands[i]) && addresses.count(operands[i]) == 0)
+      variables.insert(operands[i]);
+
+  vector<bool> isShort(opcodes.size(), false);
+  int          codeBytes = 0;
+  for (bool isChanged = true; isChanged; ) {
+    isChanged = false;
+    codeBytes = 0;
+    for (unsigned int i = 0, iInstruction = 0; i < labels.size(); ++i) {
+      if (labels[i] != "") {
+        addresses[labels[i]] = codeBytes;
+        continue;
+      }
+      codeBytes += (hasOperand(opcodes[iInstruction]) && !isShort[iInstruction]) ? 2 : 1;
+      iInstruction++;
+    }
+
+    for (unsigned int i = 0; i < opcodes.size(); ++i) {
+      if (!ExtendedISA || isShort[i] || operands[i] == "" || variables.count(operands[i]) > 0)
+        continue;
+      int value = isNumberOperand(operands[i]) ? stoi(operands[i]) : addresses[operands[i]];
+      if (canBeShort(opcodes[i], value)) {
+        isShort[i] = true;
+        isChanged  = true;
+      }
+    }
+  }
+  return codeBytes + variables.size();
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////
+//                                          MAIN
+//////////////////////////////////////////////////////////////////////////////////////////////
+
+bool compileFile(string inputName, string outputName) {
+  cout << "[debug] Compiling \"" << inputName << "\"..." << endl;
+
+  ifstream inputFile(inputName);
+  if (!inputFile) {
+    cout << "[error] No such file \"" << inputName << "\" is found." << endl;
+    return false;
+  }
+  stringstream source;
+  source << inputFile.rdbuf();
+
+  Nodes.clear();
+  Statements.clear();
+  SourceLines.clear();
+  Tokens.clear();
+  TokenLines.clear();
+  iToken            = 0;
+  LastStatementLine = 0;
+  LabelCount        = 0;
+
+  vector<int> program;
+  if (!parseProgram(source.str(), program))
+    return false;
+
+  Code          code;
+  RegisterState state;
+  code.text = "# Compiled from \"" + inputName + "\" by ./compiler" + (ExtendedISA ? " --extended" : "") + "\n";
+  generateBlock(program, code, state);
+  if (program.empty() || Statements[program.back()].kind != STATEMENT_HALT)
+    emit(code, state, HLT);
+
+  int bytes = countProgramBytes(code.text);
+  if (bytes > 256) {
+    cout << "[error] The program needs " << bytes << " bytes of code & variables, the machine only has 256." << endl;
+    return false;
+  }
+
+  fstream outputFile(outputName, fstream::out);
+  outputFile << code.text;
+  outputFile.close();
+  if (!outputFile) {
+    cout << "[error] Cannot write \"" << outputName << "\"." << endl;
+    return false;
+  }
+  cout << "[debug] Wrote \"" << outputName << "\", assemble it with ./parser" << (ExtendedISA ? " --extended" : "") << "." << endl;
+  return true;
+}
+
+int main(int argc, char *argv[]) {
+  if (argc <= 1) {
+    cout << "[usage] " << argv[0] << " [--extended] <Program.se> ..." << endl;
+    cout << "    --extended    Count the cycles of the short forms (argument 1 to 15 in the opcode)." << endl;
+    cout << "[error] No arguments are given to the program!" << endl;
+    return 0;
+  }
+
+  bool hasFailed = false;
+  for (int i = 1; i < argc; ++i) {
+    string inputName = argv[i];
+    if (inputName == "--extended") {
+      ExtendedISA = true;
+      continue;
+    }
+
+    if (inputName.length() > 3 && inputName.substr(inputName.length() - 3) == ".su") {
+      cout << "[error] \"" << inputName << "\" is already assembly." << endl;
+      hasFailed = true;
+      continue;
+    }
+    if (!compileFile(inputName, inputName.substr(0, inputName.rfind('.')) + ".su"))
+      hasFailed = true;
+  }
+  return hasFailed ? 1 : 0;
+}
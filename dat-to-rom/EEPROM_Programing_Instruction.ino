@@ -11,6 +11,12 @@
 // For time interval
 #define LOOP_INTERVAL 1000
 
+////////////////////////////
+// Extended ISA (see ../isa.h): LDI, JMP, JC, JZ, AEI & SEI
+// with their operand in the low 4 bits of the instruction.
+// Needs an OR of those 4 bits wired to address line A4.
+#define EXTENDED_ISA 0
+
 ////////////////////////////
 // For control signal
 #define HLT 0b1000000000000000
@@ -55,6 +61,8 @@
 #define _OUT 0b1110
 #define _HLT 0b1111
 
+// Same micro-steps as the table of ../isa.h, which run.cpp counts its
+// cycles from. Change both together, sketches cannot include it.
 const PROGMEM uint16_t UCODE_TEMPLATE[16][8] = {
   { MI|CO, RO|II|CE, 0,        0,        0,            0,            0, 0 }, // 0000 - NOP (do nothing)
   { MI|CO, RO|II|CE, CO|MI|CE, RO|MI,    RO|AI,        0,            0, 0 }, // 0001 - LDA (load A register from RAM)
@@ -74,6 +82,27 @@ const PROGMEM uint16_t UCODE_TEMPLATE[16][8] = {
   { MI|CO, RO|II|CE, HLT,      0,        0,            0,            0, 0 }, // 1111 - HLT (halt the clock)
 };
 
+// When the low 4 bits are not all 0, instructions without
+// a short form halt like unknown opcodes do in run.cpp.
+const PROGMEM uint16_t UCODE_SHORT_TEMPLATE[16][8] = {
+  { MI|CO, RO|II|CE, HLT,      0,            0, 0, 0, 0 }, // 0000
+  { MI|CO, RO|II|CE, HLT,      0,            0, 0, 0, 0 }, // 0001
+  { MI|CO, RO|II|CE, HLT,      0,            0, 0, 0, 0 }, // 0010
+  { MI|CO, RO|II|CE, HLT,      0,            0, 0, 0, 0 }, // 0011
+  { MI|CO, RO|II|CE, HLT,      0,            0, 0, 0, 0 }, // 0100
+  { MI|CO, RO|II|CE, IO|AI,    0,            0, 0, 0, 0 }, // 0101 - LDI n
+  { MI|CO, RO|II|CE, IO|J,     0,            0, 0, 0, 0 }, // 0110 - JMP n
+  { MI|CO, RO|II|CE, 0,        0,            0, 0, 0, 0 }, // 0111 - JC  n
+  { MI|CO, RO|II|CE, 0,        0,            0, 0, 0, 0 }, // 1000 - JZ  n
+  { MI|CO, RO|II|CE, IO|BI,    EO|AI|FI,     0, 0, 0, 0 }, // 1001 - AEI n
+  { MI|CO, RO|II|CE, IO|BI,    EO|AI|SUB|FI, 0, 0, 0, 0 }, // 1010 - SEI n
+  { MI|CO, RO|II|CE, HLT,      0,            0, 0, 0, 0 }, // 1011
+  { MI|CO, RO|II|CE, HLT,      0,            0, 0, 0, 0 }, // 1100
+  { MI|CO, RO|II|CE, HLT,      0,            0, 0, 0, 0 }, // 1101
+  { MI|CO, RO|II|CE, HLT,      0,            0, 0, 0, 0 }, // 1110
+  { MI|CO, RO|II|CE, HLT,      0,            0, 0, 0, 0 }, // 1111
+};
+
 uint16_t ucode[4][16][8];
 void createUCodeFromTemplate() {
   // CF = 0, ZF = 0
@@ -93,6 +122,13 @@ void createUCodeFromTemplate() {
   ucode[FLAG_C1Z0][_JC][3] = RO|J;
 }
 
+// Read from flash as it goes, there is no RAM left for a copy.
+uint16_t getShortMicroStep(int flag, int instruction, int cycle) {
+  if (cycle == 2 && ((instruction == _JC && (flag & FLAG_C1Z0)) || (instruction == _JZ && (flag & FLAG_C0Z1))))
+    return IO|J;
+  return pgm_read_word(&UCODE_SHORT_TEMPLATE[instruction][cycle]);
+}
+
 /*
  * Converting Ben Eater's address format into my own format
  *  == Ben Eater ==
@@ -102,12 +138,16 @@ void createUCodeFromTemplate() {
  *  ==== Mine =====
  *   | Step || Flags || Left empty || opcode |
  *     000      00          00         0000   <- What the hell was I thinking...
+ *
+ * The extended ISA takes 1 empty bit for "low 4 bits not all 0":
+ *   | Empty | Short || Flags | opcode || Step |   ->   | Step || Flags || Empty | Short || opcode |
  */
 int formatAddress(int original) {
   return 0 |
   ((original & 0b00000000111) << 8) | /* Step */
   ((original & 0b00001111000) >> 3) | /* Op code */
-  ((original & 0b00110000000) >> 1);  /* Flags */
+  ((original & 0b00110000000) >> 1) | /* Flags */
+  ((original & 0b01000000000) >> 5);  /* Short */
 }
 
 void setAddress(int address, bool outputEnable) {
@@ -172,6 +212,19 @@ void writeContent() {
       if (instruction % 3) Serial.print(".");
     }
   }
+
+#if EXTENDED_ISA
+  for (flag = FLAG_C0Z0; flag <= FLAG_C1Z1; ++flag) {
+    for (instruction = 0b0000; instruction <= 0b1111; ++instruction) {
+      for (cycle = 0b000; cycle <= 0b111; ++cycle) {
+        address = cycle + instruction * 8 + flag * 16 * 8 + 4 * 16 * 8;
+        //writeEEPROM(formatAddress(address), getShortMicroStep(flag, instruction, cycle) >> 8);
+        writeEEPROM(formatAddress(address), getShortMicroStep(flag, instruction, cycle));
+      }
+      if (instruction % 3) Serial.print(".");
+    }
+  }
+#endif
   Serial.println(" done.");
 }
 
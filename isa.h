@@ -0,0 +1,233 @@
+/* The instruction set, in one table: parser.cpp takes its mnemonics
+   from it, run.cpp & machine_constexpr.h what takes an operand &
+   the names it shows, and both of them the cycles, counted from the
+   micro-steps. Adding an instruction is adding a row, then its
+   effect in moveRegisters() & stepConstMachine(). Needs C++17.
+
+   The micro-steps are those written to the EEPROMs by
+   dat-to-rom/EEPROM_Programing_Instruction.ino, which keeps its own
+   copy since Arduino sketches only include files of their folder.
+
+   The extended ISA (--extended for both programs) gives some rows a
+   short form: the opcode with its operand, 1 to 15, in the low 4 bits
+   & no operand byte. The low 4 bits at 0 still mean the long form, so
+   every program of the base ISA runs the same when extended. */
+
+#ifndef ISA_H
+#define ISA_H
+
+#include <cstdint>
+
+/* opcode -> bytecode */
+// 4 bytes on the bottom
+// are unused because
+// I forgot to buy 1 more
+// ROM chip to have 8-bit
+// instruction set :'(
+// (but see the extended ISA)
+#define NOP  0b00000000
+#define LDA  0b00010000
+#define ADD  0b00100000
+#define SUB  0b00110000
+#define STA  0b01000000
+#define LDI  0b01010000
+#define JMP  0b01100000
+#define JC   0b01110000
+#define JZ   0b10000000
+#define AEI  0b10010000
+#define SEI  0b10100000
+#define SHL  0b10110000
+#define SLF  0b11010000
+#define _OUT 0b11100000
+#define HLT  0b11110000
+
+// Control signals of a micro-step
+const uint16_t MC_HLT = 0b1000000000000000;   // halt the clock
+const uint16_t MC_MI  = 0b0100000000000000;   // memory address in
+const uint16_t MC_RI  = 0b0010000000000000;   // RAM in
+const uint16_t MC_RO  = 0b0001000000000000;   // RAM out
+const uint16_t MC_IO  = 0b0000100000000000;   // instruction out
+const uint16_t MC_II  = 0b0000010000000000;   // instruction in
+const uint16_t MC_AO  = 0b0000001000000000;   // A out
+const uint16_t MC_AI  = 0b0000000100000000;   // A in
+const uint16_t MC_EO  = 0b0000000010000000;   // sum out
+const uint16_t MC_SU  = 0b0000000001000000;   // subtract
+const uint16_t MC_BI  = 0b0000000000100000;   // B in
+const uint16_t MC_OI  = 0b0000000000010000;   // output in
+const uint16_t MC_CE  = 0b0000000000001000;   // counter enable
+const uint16_t MC_J   = 0b0000000000000100;   // jump
+const uint16_t MC_CO  = 0b0000000000000010;   // counter out
+const uint16_t MC_FI  = 0b0000000000000001;   // flags in
+
+const int OPERAND_NONE = 0;
+const int OPERAND_BYTE = 1;     // the byte after the opcode
+
+// Flag a conditional jump looks at
+const int JUMP_ALWAYS = 0;
+const int JUMP_CARRY  = 1;
+const int JUMP_ZERO   = 2;
+
+const int MICRO_STEPS = 8;
+
+struct InstructionInfo {
+  const char* mnemonic;         // uppercase, lowercase works too
+  uint8_t     opcode;
+  int         operand;
+  int         jump;             // JUMP_CARRY/JUMP_ZERO: jumps at the first empty step when the flag is set
+  uint16_t    microSteps[MICRO_STEPS];
+  uint16_t    shortSteps[MICRO_STEPS] = {};   // of the short form, empty without one
+};
+
+constexpr InstructionInfo Instructions[] = {
+  { "NOP", NOP,  OPERAND_NONE, JUMP_ALWAYS, { MC_MI|MC_CO, MC_RO|MC_II|MC_CE } },
+  { "LDA", LDA,  OPERAND_BYTE, JUMP_ALWAYS, { MC_MI|MC_CO, MC_RO|MC_II|MC_CE, MC_CO|MC_MI|MC_CE, MC_RO|MC_MI, MC_RO|MC_AI } },
+  { "ADD", ADD,  OPERAND_BYTE, JUMP_ALWAYS, { MC_MI|MC_CO, MC_RO|MC_II|MC_CE, MC_CO|MC_MI|MC_CE, MC_RO|MC_MI, MC_RO|MC_BI, MC_EO|MC_AI|MC_FI } },
+  { "SUB", SUB,  OPERAND_BYTE, JUMP_ALWAYS, { MC_MI|MC_CO, MC_RO|MC_II|MC_CE, MC_CO|MC_MI|MC_CE, MC_RO|MC_MI, MC_RO|MC_BI, MC_EO|MC_AI|MC_SU|MC_FI } },
+  { "STA", STA,  OPERAND_BYTE, JUMP_ALWAYS, { MC_MI|MC_CO, MC_RO|MC_II|MC_CE, MC_CO|MC_MI|MC_CE, MC_RO|MC_MI, MC_AO|MC_RI } },
+  { "LDI", LDI,  OPERAND_BYTE, JUMP_ALWAYS, { MC_MI|MC_CO, MC_RO|MC_II|MC_CE, MC_CO|MC_MI|MC_CE, MC_RO|MC_AI },
+                                            { MC_MI|MC_CO, MC_RO|MC_II|MC_CE, MC_IO|MC_AI } },
+  { "JMP", JMP,  OPERAND_BYTE, JUMP_ALWAYS, { MC_MI|MC_CO, MC_RO|MC_II|MC_CE, MC_CO|MC_MI|MC_CE, MC_RO|MC_J },
+                                            { MC_MI|MC_CO, MC_RO|MC_II|MC_CE, MC_IO|MC_J } },
+  { "JC",  JC,   OPERAND_BYTE, JUMP_CARRY,  { MC_MI|MC_CO, MC_RO|MC_II|MC_CE, MC_CO|MC_MI|MC_CE },
+                                            { MC_MI|MC_CO, MC_RO|MC_II|MC_CE } },
+  { "JZ",  JZ,   OPERAND_BYTE, JUMP_ZERO,   { MC_MI|MC_CO, MC_RO|MC_II|MC_CE, MC_CO|MC_MI|MC_CE },
+                                            { MC_MI|MC_CO, MC_RO|MC_II|MC_CE } },
+  { "AEI", AEI,  OPERAND_BYTE, JUMP_ALWAYS, { MC_MI|MC_CO, MC_RO|MC_II|MC_CE, MC_CO|MC_MI|MC_CE, MC_RO|MC_BI, MC_EO|MC_AI|MC_FI },
+                                            { MC_MI|MC_CO, MC_RO|MC_II|MC_CE, MC_IO|MC_BI, MC_EO|MC_AI|MC_FI } },
+  { "SEI", SEI,  OPERAND_BYTE, JUMP_ALWAYS, { MC_MI|MC_CO, MC_RO|MC_II|MC_CE, MC_CO|MC_MI|MC_CE, MC_RO|MC_BI, MC_EO|MC_AI|MC_SU|MC_FI },
+                                            { MC_MI|MC_CO, MC_RO|MC_II|MC_CE, MC_IO|MC_BI, MC_EO|MC_AI|MC_SU|MC_FI } },
+  { "SHL", SHL,  OPERAND_BYTE, JUMP_ALWAYS, { MC_MI|MC_CO, MC_RO|MC_II|MC_CE, MC_CO|MC_MI|MC_CE, MC_RO|MC_MI, MC_RO|MC_AI|MC_BI, MC_EO|MC_AI|MC_FI } },
+  { "SLF", SLF,  OPERAND_NONE, JUMP_ALWAYS, { MC_MI|MC_CO, MC_RO|MC_II|MC_CE, MC_AO|MC_BI, MC_EO|MC_AI|MC_FI } },
+  { "OUT", _OUT, OPERAND_NONE, JUMP_ALWAYS, { MC_MI|MC_CO, MC_RO|MC_II|MC_CE, MC_AO|MC_OI } },
+  { "HLT", HLT,  OPERAND_NONE, JUMP_ALWAYS, { MC_MI|MC_CO, MC_RO|MC_II|MC_CE, MC_HLT } },
+};
+
+const int INSTRUCTION_COUNT = sizeof(Instructions) / sizeof(Instructions[0]);
+
+// Cycles the emulator counts: one per micro-step until the first
+// empty one, the step halting the clock is never reached.
+constexpr int countMicroSteps(const InstructionInfo &info, const uint16_t* microSteps, bool jumpTaken) {
+  int steps = 0;
+  while (steps < MICRO_STEPS && microSteps[steps] != 0 && !(microSteps[steps] & MC_HLT))
+    steps++;
+  if (jumpTaken && info.jump != JUMP_ALWAYS)
+    steps++;            // RO|J, IO|J for the short form
+  return steps;
+}
+
+constexpr bool hasShortForm(const InstructionInfo &info) {
+  return info.shortSteps[0] != 0;
+}
+
+/* Everything above looked up by opcode, with no search
+   nor switch. Bytes that are no opcode stop the machine
+   after the 2 cycles of the fetch. */
+struct OpcodeTable {
+  int8_t  index[256];           // row of Instructions, -1 when unknown
+  uint8_t base[256];            // opcode of the row, the byte itself when unknown
+  bool    isShort[256];
+  bool    hasOperand[256];      // an operand byte follows
+  uint8_t cycles[256][2];       // [jump taken]
+  char    lowercase[INSTRUCTION_COUNT][4];
+};
+
+constexpr OpcodeTable makeOpcodeTable(bool extended) {
+  OpcodeTable table = {};
+  for (int opcode = 0; opcode < 256; ++opcode) {
+    table.index[opcode]     = -1;
+    table.base[opcode]      = opcode;
+    table.cycles[opcode][0] = table.cycles[opcode][1] = 2;
+  }
+
+  for (int i = 0; i < INSTRUCTION_COUNT; ++i) {
+    const InstructionInfo &info = Instructions[i];
+    table.index[info.opcode]      = i;
+    table.hasOperand[info.opcode] = (info.operand != OPERAND_NONE);
+    table.cycles[info.opcode][0]  = countMicroSteps(info, info.microSteps, false);
+    table.cycles[info.opcode][1]  = countMicroSteps(info, info.microSteps, true);
+    for (int c = 0; info.mnemonic[c] != '\0'; ++c)
+      table.lowercase[i][c] = (info.mnemonic[c] >= 'A' && info.mnemonic[c] <= 'Z') ? info.mnemonic[c] - 'A' + 'a' : info.mnemonic[c];
+
+    for (int operand = 1; extended && hasShortForm(info) && operand <= 15; ++operand) {
+      int opcode = info.opcode | operand;
+      table.index[opcode]     = i;
+      table.base[opcode]      = info.opcode;
+      table.isShort[opcode]   = true;
+      table.cycles[opcode][0] = countMicroSteps(info, info.shortSteps, false);
+      table.cycles[opcode][1] = countMicroSteps(info, info.shortSteps, true);
+    }
+  }
+  return table;
+}
+
+constexpr OpcodeTable Opcodes         = makeOpcodeTable(false);
+constexpr OpcodeTable ExtendedOpcodes = makeOpcodeTable(true);
+
+constexpr const OpcodeTable& getOpcodeTable(bool extended) {
+  return extended ? ExtendedOpcodes : Opcodes;
+}
+
+constexpr bool isKnownOpcode(int opcode, bool extended = false) {
+  return getOpcodeTable(extended).index[opcode & 0xff] >= 0;
+}
+
+// LDI for LDI & its short forms
+constexpr int getBaseOpcode(int opcode, bool extended = false) {
+  return getOpcodeTable(extended).base[opcode & 0xff];
+}
+
+// Its operand is then in the low 4 bits.
+constexpr bool isShortForm(int opcode, bool extended = false) {
+  return getOpcodeTable(extended).isShort[opcode & 0xff];
+}
+
+constexpr bool hasOperand(int opcode, bool extended = false) {
+  return getOpcodeTable(extended).hasOperand[opcode & 0xff];
+}
+
+// Whether an instruction can take <operand> in its low 4 bits
+constexpr bool canBeShort(int opcode, int operand) {
+  return operand >= 1 && operand <= 15 && isShortForm(opcode | operand, true);
+}
+
+constexpr int getInstructionCycles(int opcode, bool jumpTaken, bool extended = false) {
+  return getOpcodeTable(extended).cycles[opcode & 0xff][jumpTaken];
+}
+
+// "???" for bytes that are no opcode
+constexpr const char* getMnemonic(int opcode, bool extended = false) {
+  return isKnownOpcode(opcode, extended) ? Instructions[getOpcodeTable(extended).index[opcode & 0xff]].mnemonic : "???";
+}
+
+// Control signals of micro-step <step>, 0 past the last one
+// (where a conditional jump taken does RO|J or IO|J).
+// Bytes that are no opcode only have the fetch.
+constexpr uint16_t getMicroStep(int opcode, int step, bool extended = false) {
+  const OpcodeTable &table = getOpcodeTable(extended);
+  int index = table.index[opcode & 0xff];
+  if (step < 0 || step >= MICRO_STEPS)
+    return 0;
+  if (index < 0)
+    return (step < 2) ? Instructions[0].microSteps[step] : 0;
+  return table.isShort[opcode & 0xff] ? Instructions[index].shortSteps[step] : Instructions[index].microSteps[step];
+}
+
+constexpr bool isWellFormedTable() {
+  for (int i = 0; i < INSTRUCTION_COUNT; ++i) {
+    const InstructionInfo &info = Instructions[i];
+    if (Opcodes.index[info.opcode] != i)      // two rows with the same opcode
+      return false;
+    if ((info.opcode & 0x0f) != 0)            // the low 4 bits are for short forms
+      return false;
+    int length = 0;
+    while (info.mnemonic[length] != '\0')
+      length++;
+    if (length == 0 || length > 3)
+      return false;
+  }
+  return true;
+}
+
+static_assert(isWellFormedTable(), "opcodes must differ & end with 4 zeros, mnemonics be 1 to 3 letters");
+
+#endif
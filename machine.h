@@ -0,0 +1,96 @@
+/* C interface to the machine of run.cpp, to run programs in-process
+   instead of spawning ./run. Built from run.cpp itself, without the
+   screen or main():
+
+     g++ -std=c++17 -O2 -DLIBRARY -fPIC -shared run.cpp -o libmachine.so -pthread
+     g++ -std=c++17 -O2 -DLIBRARY -c run.cpp -o machine.o && ar rcs libmachine.a machine.o
+
+   Machines stop between instructions, but for machine_tick() which
+   can leave one in the middle of an instruction, to go on from there
+   on the next call. Machines share nothing & take no lock, so any
+   number of them can run on any threads at once, but a single
+   machine must not be used by two threads at the same time.
+   Functions taking a machine return MACHINE_ERROR when it is NULL or
+   an argument is out of range. */
+
+#ifndef MACHINE_H
+#define MACHINE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Bumped whenever a function below changes its meaning. */
+#define MACHINE_API_VERSION 2
+
+typedef struct Machine Machine;
+
+/* Where a machine is */
+#define MACHINE_ERROR   (-1)
+#define MACHINE_PAUSED  0      /* can go on */
+#define MACHINE_HALTED  1      /* executed HLT */
+#define MACHINE_UNKNOWN 2      /* fetched an unknown opcode */
+
+/* Registers, for machine_get_register() & machine_set_register() */
+#define MACHINE_MAR 0
+#define MACHINE_A   1
+#define MACHINE_B   2
+#define MACHINE_SUM 3
+#define MACHINE_IR  4
+#define MACHINE_PC  5
+#define MACHINE_OUT 6
+#define MACHINE_ZF  7
+#define MACHINE_CF  8
+
+int machine_api_version(void);
+
+/* A machine with zeros in memory, NULL when out of memory. */
+Machine* machine_create(void);
+void     machine_destroy(Machine* machine);
+
+/* Loads <size> bytes (at most 256, zeros after them), then resets. */
+int machine_load(Machine* machine, const uint8_t* image, size_t size);
+
+/* Back to the loaded image, registers, cycles & outputs cleared. */
+int machine_reset(Machine* machine);
+
+/* Runs up to <instructions> whole instructions, the first one being
+   the rest of the instruction a machine_tick() stopped in. */
+int machine_step(Machine* machine, long instructions);
+
+/* Runs until HLT, an unknown opcode, or until <max_cycles> more
+   cycles have been spent, finishing the instruction it is in. */
+int machine_run(Machine* machine, long max_cycles);
+
+/* Runs until HLT, an unknown opcode, or <micro_steps> more cycles,
+   stopping in the middle of an instruction if need be. One thread
+   can take turns between many machines with small slices. */
+int machine_tick(Machine* machine, long micro_steps);
+
+/* Micro-steps already run of the instruction the machine is in, 0
+   between instructions. */
+int machine_micro_step(const Machine* machine);
+
+int machine_status(const Machine* machine);
+int machine_cycles(const Machine* machine);
+
+/* <count> bytes from <address>, all inside the 256 bytes of memory. */
+int machine_read(const Machine* machine, int address, uint8_t* buffer, size_t count);
+int machine_write(Machine* machine, int address, const uint8_t* buffer, size_t count);
+
+/* The value (0 to 255) or MACHINE_ERROR. */
+int machine_get_register(const Machine* machine, int reg);
+int machine_set_register(Machine* machine, int reg, uint8_t value);
+
+/* Copies at most <capacity> of the values OUT has shown since the
+   last reset, returning how many there are in total. */
+size_t machine_outputs(const Machine* machine, uint8_t* buffer, size_t capacity);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
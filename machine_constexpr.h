@@ -0,0 +1,219 @@
+/* The instructions of run.cpp as constexpr functions, so a memory
+   image can be run while compiling & what it leaves behind used as
+   constants or checked with static_assert:
+
+     constexpr ConstMachine m = runConstMachine({ 0x50, 0x07, 0xe0, 0xf0 });
+     static_assert(m.stop == CONST_STOP_HLT && m.outputs[0] == 7, "");
+
+   Same registers, cycles & stop reasons as run() in batch mode, without
+   breakpoints, watchpoints or the screen. run.cpp takes
+   performArithmetic() from here. Long runs can reach the compiler's
+   limits, raised with -fconstexpr-ops-limit=N (g++) or
+   -fconstexpr-steps=N (clang++). Needs C++17. */
+
+#ifndef MACHINE_CONSTEXPR_H
+#define MACHINE_CONSTEXPR_H
+
+#include <cstddef>
+#include <cstdint>
+
+#include "isa.h"
+
+// Why a ConstMachine stopped, as StopReason in run.cpp
+const int CONST_RUNNING      = 0;
+const int CONST_STOP_HLT     = 1;
+const int CONST_STOP_UNKNOWN = 2;
+const int CONST_STOP_BUDGET  = 3;
+
+const int CONST_OUTPUTS = 256;   // OUT values kept, the count goes on
+
+struct ConstMachine {
+  uint8_t RAMContent[256] = {};
+  uint8_t MemRegister     = 0;
+  uint8_t ARegister       = 0;
+  uint8_t BRegister       = 0;
+  uint8_t SumRegister     = 0;
+  uint8_t Instruction     = 0;
+  uint8_t ProgramCounter  = 0;
+  uint8_t OutRegister     = 0;
+  uint8_t ZeroFlag        = 0;
+  uint8_t CarryFlag       = 0;
+  int     cycleCounting   = 0;
+  int     cycleBudget     = 10000000;
+  int     stop            = CONST_RUNNING;
+  uint8_t outputs[CONST_OUTPUTS] = {};
+  int     outputCount     = 0;
+  bool    extended        = false;   // short forms of the extended ISA
+};
+
+constexpr uint8_t performArithmetic(uint8_t A, uint8_t B, uint8_t &ZeroFlag, uint8_t &CarryFlag, bool SUB_FLAG, bool FLAG_IN) {
+  uint16_t A_16   = A & 0b11111111;
+  uint16_t B_16   = B & 0b11111111;
+  uint16_t result_16 = 0;
+  if (SUB_FLAG)
+    result_16 = A_16 + (~B_16 & 0b11111111) + 1;
+  else
+    result_16 = A_16 + B_16;
+
+  if (FLAG_IN) {
+    CarryFlag = ((result_16 >> 8) & 0x1) ^ SUB_FLAG;
+    ZeroFlag  = ((result_16 & 0b11111111) == 0);
+  }
+
+  uint8_t result_8 = result_16 & 0b11111111;
+  return result_8;
+}
+
+// One cycle, false once the budget is spent (countCycle()).
+constexpr bool tickConstMachine(ConstMachine &m) {
+  m.cycleCounting++;
+  if (m.cycleCounting >= m.cycleBudget) {
+    m.stop = CONST_STOP_BUDGET;
+    return false;
+  }
+  return true;
+}
+
+// A = A +/- B, the flags set from it, then SUM from the new A.
+constexpr bool addConstMachine(ConstMachine &m, bool subtract) {
+  m.SumRegister = performArithmetic(m.ARegister, m.BRegister, m.ZeroFlag, m.CarryFlag, subtract, true);
+  if (!tickConstMachine(m))
+    return false;
+
+  m.ARegister   = m.SumRegister;
+  m.SumRegister = performArithmetic(m.ARegister, m.BRegister, m.ZeroFlag, m.CarryFlag, false, false);
+  return tickConstMachine(m);
+}
+
+// Fetches & executes one instruction, as runInstruction()
+// does, stopping in the middle of it on the budget.
+constexpr void stepConstMachine(ConstMachine &m) {
+  if (m.stop != CONST_RUNNING || !tickConstMachine(m))
+    return;
+
+  m.MemRegister = m.ProgramCounter++;
+  m.Instruction = m.RAMContent[m.MemRegister];
+  if (!tickConstMachine(m))
+    return;
+
+  if (hasOperand(m.Instruction, m.extended)) {
+    m.MemRegister = m.ProgramCounter++;
+    if (!tickConstMachine(m))
+      return;
+  }
+
+  // Short forms take their operand from the low 4 bits
+  bool    isShort = isShortForm(m.Instruction, m.extended);
+  uint8_t operand = isShort ? (m.Instruction & 0x0f) : m.RAMContent[m.MemRegister];
+
+  switch (getBaseOpcode(m.Instruction, m.extended)) {
+    case LDA:
+      m.MemRegister = m.RAMContent[m.MemRegister];
+      if (!tickConstMachine(m))
+        return;
+
+      m.ARegister   = m.RAMContent[m.MemRegister];
+      m.SumRegister = performArithmetic(m.ARegister, m.BRegister, m.ZeroFlag, m.CarryFlag, false, false);
+      tickConstMachine(m);
+      break;
+
+    case ADD:
+    case SUB:
+      m.MemRegister = m.RAMContent[m.MemRegister];
+      if (!tickConstMachine(m))
+        return;
+
+      m.BRegister = m.RAMContent[m.MemRegister];
+      addConstMachine(m, m.Instruction == SUB);
+      break;
+
+    case STA:
+      m.MemRegister = m.RAMContent[m.MemRegister];
+      if (!tickConstMachine(m))
+        return;
+
+      m.RAMContent[m.MemRegister] = m.ARegister;
+      tickConstMachine(m);
+      break;
+
+    case LDI:
+      m.ARegister   = operand;
+      m.SumRegister = performArithmetic(m.ARegister, m.BRegister, m.ZeroFlag, m.CarryFlag, false, false);
+      tickConstMachine(m);
+      break;
+
+    case JC:
+    case JZ:
+    case JMP:
+      if ((getBaseOpcode(m.Instruction, m.extended) == JC && m.CarryFlag == 0)
+          || (getBaseOpcode(m.Instruction, m.extended) == JZ && m.ZeroFlag == 0))
+        break;
+
+      m.ProgramCounter = operand;
+      tickConstMachine(m);
+      break;
+
+    case AEI:
+    case SEI:
+      m.BRegister = operand;
+      addConstMachine(m, getBaseOpcode(m.Instruction, m.extended) == SEI);
+      break;
+
+    case SHL:
+      m.MemRegister = m.RAMContent[m.MemRegister];
+      if (!tickConstMachine(m))
+        return;
+
+      m.ARegister = m.BRegister = m.RAMContent[m.MemRegister];
+      addConstMachine(m, false);
+      break;
+
+    case SLF:
+      m.BRegister = m.ARegister;
+      addConstMachine(m, false);
+      break;
+
+    case _OUT:
+      m.OutRegister = m.ARegister;
+      if (m.outputCount < CONST_OUTPUTS)
+        m.outputs[m.outputCount] = m.OutRegister;
+      m.outputCount++;
+      tickConstMachine(m);
+      break;
+
+    case HLT:
+      m.stop = CONST_STOP_HLT;
+      break;
+
+    case NOP:
+      break;
+
+    default:
+      m.stop = CONST_STOP_UNKNOWN;
+      break;
+  }
+}
+
+constexpr void runConstMachine(ConstMachine &m) {
+  while (m.stop == CONST_RUNNING)
+    stepConstMachine(m);
+}
+
+// Runs <size> bytes (at most 256, zeros after them) from a reset machine.
+constexpr ConstMachine runConstMachine(const uint8_t* image, size_t size, int cycleBudget = 10000000, bool extended = false) {
+  ConstMachine m;
+  for (size_t i = 0; i < size && i < 256; ++i)
+    m.RAMContent[i] = image[i];
+  m.cycleBudget = cycleBudget;
+  m.extended    = extended;
+  runConstMachine(m);
+  return m;
+}
+
+template <size_t N>
+constexpr ConstMachine runConstMachine(const uint8_t (&image)[N], int cycleBudget = 10000000, bool extended = false) {
+  static_assert(N <= 256, "an image is at most 256 bytes");
+  return runConstMachine(image, N, cycleBudget, extended);
+}
+
+#endif
@@ -2,95 +2,199 @@
 #include <fstream>
 #include <sstream>
 #include <vector>
+#include <deque>
 #include <stack>
 #include <map>
+#include <set>
+#include <algorithm>
+#include <iomanip>
+#include <string_view>
+#include <cstdint>
+#include <chrono>
+#include <filesystem>
+#include <random>
+
+#if defined(__unix__) && !defined(WIN32)
+  #include <fcntl.h>
+  #include <unistd.h>
+  #include <sys/mman.h>
+  #include <sys/stat.h>
+#endif
 using namespace std;
 
-/* opcode -> bytecode */
-// 4 bytes on the bottom
-// are unused because
-// I forgot to buy 1 more
-// ROM chip to have 8-bit
-// instruction set :'(
-#define NOP  0b00000000
-#define LDA  0b00010000
-#define ADD  0b00100000
-#define SUB  0b00110000
-#define STA  0b01000000
-#define LDI  0b01010000
-#define JMP  0b01100000
-#define JC   0b01110000
-#define JZ   0b10000000
-#define AEI  0b10010000
-#define SEI  0b10100000
-#define SHL  0b10110000
-#define SLF  0b11010000
-#define _OUT 0b11100000
-#define HLT  0b11110000
+#include "isa.h"                 // opcodes, mnemonics & cycles
+#include "machine_constexpr.h"   // runs the programs of --generate
+
+/* A byte of an object that the linker moves: it gets the
+   final address of its target, minus the address the
+   object was assembled with (code from 0, variables
+   from 0xff down, 0 for what other files export). */
+const int RELOC_CODE     = 0;             // a tag of the same file
+const int RELOC_VARIABLE = 1;             // a variable of the same file
+const int RELOC_EXTERN   = 2;             // a name another file exports
+
+struct Relocation {
+  int    offset;
+  int    kind;
+  string name;                            // of the tag, variable or extern
+};
+
+/* A relocatable object (--object, --link): the
+   code as if it were linked alone, and what the
+   linker needs to move it next to others */
+struct ObjectFile {
+  string                     fileName;
+  bool                       isExtended = false;
+  vector<int>                code;
+  vector<int>                instructionAddresses;
+  vector<pair<string, int> > tags;        // tag -> offset
+  map<int, int>              loopBounds;  // offset -> max iterations
+  vector<pair<string, int> > variables;   // variable -> address when linked alone
+  map<string, int>           initializers;// variable -> offset of the LDI operand setting it
+  vector<string>             globals;     // tags & variables other files can use
+  vector<string>             externs;     // names other files export
+  vector<Relocation>         relocations;
+};
+
+/* What the assembler knows about a
+   program besides its bytes, used by
+   the analysis */
+struct ProgramInfo {
+  map<int, string> tagNames;              // address -> tag
+  map<int, int>    loopBounds;            // tag address -> max iterations (# @bound N)
+  vector<int>      instructionAddresses;  // where each assembled instruction starts
+  int              codeSize;              // bytes of code & raw data
+  vector<bool>     isShortLine;           // line -> short form? (extended ISA)
+  ObjectFile*      object = NULL;         // filled in when assembling an object
+
+  /* The symbol map (".sym") */
+  vector<pair<string, int> > tags;        // every tag & its address
+  vector<pair<string, int> > variables;   // every variable & its address
+  map<string, int>           initializers;// variable -> address of the operand of "LDI n" before the first "STA <variable>"
+};
+
+/* Names -> numbers, open addressing in a table of
+   a power of two size. Names are views into the
+   source or the expanded lines, never copied. */
+struct SymbolTable {
+  vector<string_view> names;              // no data() for an empty slot
+  vector<int>         values;
+  unsigned int        count = 0;
+};
 
 /* alphabet */
-map<string, int> code;
-string           sortedVariableAlphabet   = "$0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZ_abcdefghijklmnopqrstuvwxyz";
-string           optionalOperatorAlphabet = "+-*";
+SymbolTable code;
+bool        ExtendedISA = false;          // short forms of isa.h
+string      variableAlphabet         = "$0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZ_abcdefghijklmnopqrstuvwxyz";
+string      optionalOperatorAlphabet = "+-*";
+
+/* character classes, one lookup per character */
+const uint8_t CHAR_SPACE    = 1 << 0;     // separates words, like >> does
+const uint8_t CHAR_DIGIT    = 1 << 1;
+const uint8_t CHAR_NAME     = 1 << 2;     // in tags & variables
+const uint8_t CHAR_PARAM    = 1 << 3;     // in \param of macros
+const uint8_t CHAR_OPERATOR = 1 << 4;     // optional operators on addresses
+uint8_t       charClass[256];
+
+//////////////////////////////////////////////////////////////////////////////////////////////
+//                                    SYMBOL FUNCTIONS
+//////////////////////////////////////////////////////////////////////////////////////////////
+
+inline bool hasClass(char c, uint8_t classes) {
+  return charClass[(unsigned char)c] & classes;
+}
+
+inline uint32_t hashName(string_view name) {
+  uint32_t hash = 2166136261u;
+  for (unsigned int i = 0; i < name.size(); ++i) {
+    hash ^= (unsigned char)name[i];
+    hash *= 16777619u;            // FNV-1a
+  }
+  return hash;
+}
+
+// Slot holding "name", or the empty one where it would go.
+inline unsigned int findSlot(const SymbolTable& table, string_view name) {
+  unsigned int mask = table.names.size() - 1;
+  unsigned int slot = hashName(name) & mask;
+  while (table.names[slot].data() != NULL && table.names[slot] != name)
+    slot = (slot + 1) & mask;
+  return slot;
+}
+
+inline bool findSymbol(const SymbolTable& table, string_view name, int& value) {
+  if (table.count == 0)
+    return false;
+
+  unsigned int slot = findSlot(table, name);
+  if (table.names[slot].data() == NULL)
+    return false;
+  value = table.values[slot];
+  return true;
+}
+
+void setSymbol(SymbolTable& table, string_view name, int value) {
+  // Keep at least half of the slots empty
+  if ((table.count + 1) * 2 > table.names.size()) {
+    SymbolTable grown;
+    grown.names.resize(max<size_t>(16, table.names.size() * 2));
+    grown.values.resize(grown.names.size());
+    for (unsigned int i = 0; i < table.names.size(); ++i) {
+      if (table.names[i].data() != NULL)
+        setSymbol(grown, table.names[i], table.values[i]);
+    }
+    table = move(grown);
+  }
+
+  unsigned int slot = findSlot(table, name);
+  if (table.names[slot].data() == NULL) {
+    table.names[slot] = name;
+    table.count++;
+  }
+  table.values[slot] = value;
+}
 
 //////////////////////////////////////////////////////////////////////////////////////////////
 //                                   CATEGORIZE FUNCTIONS
 //////////////////////////////////////////////////////////////////////////////////////////////
 
-inline bool isInt(string s) {
+inline bool isInt(string_view s) {
   for (unsigned int i = 0; i < s.length(); i++) {
-    if (s[i] < '0' || s[i] > '9') 
+    if (!hasClass(s[i], CHAR_DIGIT))
       return false;
   }
   return true;
 }
 
-inline bool isVariableExists(string varName, map<string, int> variableMap) {
-  return !(variableMap.find(varName) == variableMap.end());
+inline bool isVariableExists(string_view varName, const SymbolTable& variableMap) {
+  int address;
+  return findSymbol(variableMap, varName, address);
 }
 
-inline bool isInstruction(string opcode) {
-  return !(code.find(opcode) == code.end());
+inline bool isInstruction(string_view opcode) {
+  int bytecode;
+  return findSymbol(code, opcode, bytecode);
 }
 
-inline bool isTag(string opCode) {
-  return opCode[opCode.length() - 1] == ':';
+inline bool isTag(string_view opCode) {
+  return opCode.length() > 0 && opCode[opCode.length() - 1] == ':';
 }
 
-inline bool isGoodVariableName(string varName) {
+inline bool isGoodVariableName(string_view varName) {
   if (isInt(varName)) {
     return false;
   }
 
-  for (int i = 0; i < varName.length(); ++i) {
-    int l = 0;
-    int r = sortedVariableAlphabet.length() - 1;
-    int m = -1;
-
-    unsigned char varchr = varName[i];
-    bool isInAlphabet = false;
-    while (r >= l) {
-      m = (l + r) / 2;
-      if (varchr == (unsigned char)sortedVariableAlphabet[m]) {
-        isInAlphabet = true;
-        break;
-      }
-      else if (varchr > (unsigned char)sortedVariableAlphabet[m])
-        l = m+1;
-      else if (varchr < (unsigned char)sortedVariableAlphabet[m])
-        r = m-1;
-    }
-
-    if (!isInAlphabet) {
+  for (unsigned int i = 0; i < varName.length(); ++i) {
+    if (!hasClass(varName[i], CHAR_NAME))
       return false;
-    }
   }
 
   return true;
 }
 
-inline bool isGoodOptionalOperator(string optionalOperator) {
-  return optionalOperator.length() == 1 && optionalOperatorAlphabet.find(optionalOperator) != -1;
+inline bool isGoodOptionalOperator(string_view optionalOperator) {
+  return optionalOperator.length() == 1 && hasClass(optionalOperator[0], CHAR_OPERATOR);
 }
 
 //////////////////////////////////////////////////////////////////////////////////////////////
@@ -106,101 +210,528 @@ inline string toBinaryString(T data, int bits) {
   return binData;
 }
 
-inline int toInteger(string numString) {
-  return atoi(&numString[0]);
+// Way past anything an 8-bit machine needs, small
+// enough that sums & products cannot overflow.
+const int MAX_INTEGER = 1 << 24;
+
+// Reads like strtoll() does, but clamped.
+inline int toInteger(string_view numString) {
+  unsigned int i = 0;
+  while (i < numString.length() && hasClass(numString[i], CHAR_SPACE))
+    i++;
+
+  bool isNegative = false;
+  if (i < numString.length() && (numString[i] == '+' || numString[i] == '-'))
+    isNegative = (numString[i++] == '-');
+
+  long long number = 0;
+  for (; i < numString.length() && hasClass(numString[i], CHAR_DIGIT); ++i)
+    number = min(number * 10 + (numString[i] - '0'), (long long)MAX_INTEGER);
+  return isNegative ? -number : number;
+}
+
+// "loop:  # @bound 8" -> 8, otherwise 0
+inline int getLoopBound(string_view codeLine) {
+  auto boundPos = codeLine.find("@bound");
+  if (boundPos == string_view::npos || codeLine.find('#') > boundPos)
+    return 0;
+  return toInteger(codeLine.substr(boundPos + 6));
+}
+
+inline string_view filterComment(string_view codeLine) {
+  return codeLine.substr(0, codeLine.find('#'));
+}
+
+// Next word of the line from "pos" on, empty when there is
+// none left. Same words as >> would give, without copies.
+inline string_view nextWord(string_view codeLine, size_t& pos) {
+  while (pos < codeLine.length() && hasClass(codeLine[pos], CHAR_SPACE))
+    pos++;
+
+  size_t start = pos;
+  while (pos < codeLine.length() && !hasClass(codeLine[pos], CHAR_SPACE))
+    pos++;
+  return codeLine.substr(start, pos - start);
+}
+
+inline string_view trimSpacesAndTabs(string_view text) {
+  size_t start = text.find_first_not_of(" \t");
+  if (start == string_view::npos)
+    return string_view();
+  return text.substr(start, text.find_last_not_of(" \t") - start + 1);
 }
 
-inline void filterComment(string &codeLine) {
-  auto commentPos = codeLine.find('#');
-  if (commentPos != string::npos) {
-    codeLine.erase(commentPos);
+// "argument [+-* optionalArgument]" when it is known by now:
+// numbers, and names already in the map.
+inline bool getArgumentValue(string_view argument, string_view optionalOperator, string_view optionalArgument,
+                             const SymbolTable& variableMap, long long& value) {
+  int address = 0;
+  if (argument != "" && isInt(argument))
+    value = toInteger(argument);
+  else if (findSymbol(variableMap, argument, address))
+    value = address;
+  else
+    return false;
+
+  if (optionalOperator == "")
+    return true;
+  if (!isGoodOptionalOperator(optionalOperator) || optionalArgument == "" || !isInt(optionalArgument))
+    return false;
+
+  switch (optionalOperator[0]) {
+    case '+': value += toInteger(optionalArgument); break;
+    case '-': value -= toInteger(optionalArgument); break;
+    case '*': value *= toInteger(optionalArgument); break;
   }
+  return true;
 }
 
 //////////////////////////////////////////////////////////////////////////////////////////////
 //                                 INITIALIZE FUNCTIONS
 //////////////////////////////////////////////////////////////////////////////////////////////
 
+// For uppercase & lowercase users
 void mapOPCode() {
-  // For uppercase users
-  code["NOP"] = NOP;
-  code["LDA"] = LDA;
-  code["ADD"] = ADD;
-  code["SUB"] = SUB;
-  code["STA"] = STA;
-  code["LDI"] = LDI;
-  code["JMP"] = JMP;
-  code["JC" ] = JC ;
-  code["JZ" ] = JZ ;
-  code["AEI"] = AEI;
-  code["SEI"] = SEI;
-  code["SHL"] = SHL;
-  code["SLF"] = SLF;
-  code["OUT"] = _OUT;
-  code["HLT"] = HLT;
-  
-  // For lowercase users
-  code["nop"] = NOP;
-  code["lda"] = LDA;
-  code["add"] = ADD;
-  code["sub"] = SUB;
-  code["sta"] = STA;
-  code["ldi"] = LDI;
-  code["jmp"] = JMP;
-  code["jc" ] = JC ;
-  code["jz" ] = JZ ;
-  code["aei"] = AEI;
-  code["sei"] = SEI;
-  code["shl"] = SHL;
-  code["slf"] = SLF;
-  code["out"] = _OUT;
-  code["hlt"] = HLT;
+  for (int i = 0; i < INSTRUCTION_COUNT; ++i) {
+    string_view mnemonic = Instructions[i].mnemonic;
+    setSymbol(code, mnemonic, Instructions[i].opcode);
+    setSymbol(code, string_view(Opcodes.lowercase[i], mnemonic.length()), Instructions[i].opcode);
+  }
+}
+
+void mapCharClasses() {
+  string spaces = " \t\n\v\f\r";
+  for (unsigned int i = 0; i < spaces.length(); ++i)
+    charClass[(unsigned char)spaces[i]] |= CHAR_SPACE;
+  for (unsigned int i = 0; i < variableAlphabet.length(); ++i)
+    charClass[(unsigned char)variableAlphabet[i]] |= CHAR_NAME;
+  for (unsigned int i = 0; i < optionalOperatorAlphabet.length(); ++i)
+    charClass[(unsigned char)optionalOperatorAlphabet[i]] |= CHAR_OPERATOR;
+  for (int c = 0; c < 256; ++c) {
+    if (c >= '0' && c <= '9')
+      charClass[c] |= CHAR_DIGIT | CHAR_PARAM;
+    if ((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '_' || c == '@')
+      charClass[c] |= CHAR_PARAM;
+  }
 }
 
 void initGlobal() {
   mapOPCode();
+  mapCharClasses();
 }
 
 //////////////////////////////////////////////////////////////////////////////////////////////
 //                                 COMPILING FUNCTIONS
 //////////////////////////////////////////////////////////////////////////////////////////////
 
-bool compileTags(fstream& codeFile, map<string, int>& variableMap) {
+/* The source file is mapped in memory (or read in one go when
+   it cannot be), every line & word is then a view into it. */
+struct SourceFile {
+  const char* data;
+  size_t      size;
+  bool        isMapped;
+  string      buffer;     // when not mapped
+};
+
+bool openSourceFile(string filename, SourceFile& source) {
+  source.data     = NULL;
+  source.size     = 0;
+  source.isMapped = false;
+
+  #if defined(__unix__) && !defined(WIN32)
+    int fileDescriptor = open(filename.c_str(), O_RDONLY);
+    if (fileDescriptor < 0)
+      return false;
+
+    struct stat fileInfo;
+    if (fstat(fileDescriptor, &fileInfo) == 0 && S_ISREG(fileInfo.st_mode) && fileInfo.st_size > 0) {
+      void* mapping = mmap(NULL, fileInfo.st_size, PROT_READ, MAP_PRIVATE, fileDescriptor, 0);
+      if (mapping != MAP_FAILED) {
+        source.data     = (const char*)mapping;
+        source.size     = fileInfo.st_size;
+        source.isMapped = true;
+        close(fileDescriptor);
+        return true;
+      }
+    }
+    close(fileDescriptor);
+  #endif
+
+  ifstream codeFile(filename, ios::binary);
+  if (!codeFile)
+    return false;
+
+  stringstream contents;
+  contents << codeFile.rdbuf();
+  source.buffer = contents.str();
+  source.data   = source.buffer.data();
+  source.size   = source.buffer.size();
+  return true;
+}
+
+void closeSourceFile(SourceFile& source) {
+  #if defined(__unix__) && !defined(WIN32)
+    if (source.isMapped)
+      munmap((void*)source.data, source.size);
+  #endif
+  source.isMapped = false;
+}
+
+// Lines as getline() would give them.
+void splitLines(string_view source, vector<string_view>& lines) {
+  size_t start = 0;
+  while (start < source.length()) {
+    size_t end = source.find('\n', start);
+    if (end == string_view::npos)
+      end = source.length();
+    lines.push_back(source.substr(start, end - start));
+    start = end + 1;
+  }
+}
+
+/*  .macro <name> [<param> ...]      .rep <count> [<counter> [<first>]]
+        ... \param ... \@                ... \counter ...
+    .endm                             .endr
+
+    A macro is used like an instruction: "<name> arg ..."
+    (arguments separated by commas if there are any, else
+    by spaces). Inside the body \param is replaced by its
+    argument and \@ by a number unique to each expansion,
+    for tags like "skip_\@:". A .rep block is repeated
+    <count> times, \counter going from <first> (default 0). */
+
+const int MAX_EXPANSION_DEPTH = 64;
+const int MAX_EXPANSIONS      = 1 << 16;    // macro uses, .rep rounds & lines they make
+
+struct Macro {
+  vector<string_view> parameters;
+  vector<string_view> body;
+};
+
+struct Expansion {
+  map<string_view, Macro> macros;
+  vector<string_view>     lines;        // the whole program, expanded
+  deque<string>           storage;      // lines changed by substitutions
+  int                     count;        // macro uses & .rep rounds
+  int                     lineCount;    // lines made by them
+  vector<string_view>     globals;      // .global <name> ...
+  vector<string_view>     externs;      // .extern <name> ...
+};
+
+// Replace every \name found in "substitutions" inside the line.
+string substituteParameters(string_view codeLine, map<string_view, string>& substitutions) {
+  string substituted;
+  for (unsigned int i = 0; i < codeLine.length(); ++i) {
+    if (codeLine[i] != '\\') {
+      substituted += codeLine[i];
+      continue;
+    }
+
+    unsigned int nameEnd = i + 1;
+    while (nameEnd < codeLine.length() && hasClass(codeLine[nameEnd], CHAR_PARAM))
+      nameEnd++;
+
+    string_view name = codeLine.substr(i + 1, nameEnd - i - 1);
+    if (substitutions.find(name) != substitutions.end()) {
+      substituted += substitutions[name];
+      i = nameEnd - 1;
+    }
+    else {
+      substituted += codeLine[i];
+    }
+  }
+  return substituted;
+}
+
+// Only lines with a \ are copied, the others are kept as views.
+void substituteLines(vector<string_view>& body, map<string_view, string>& substitutions, Expansion& expansion, vector<string_view>& substitutedLines) {
+  for (unsigned int iBody = 0; iBody < body.size(); ++iBody) {
+    if (substitutions.empty() || body[iBody].find('\\') == string_view::npos) {
+      substitutedLines.push_back(body[iBody]);
+      continue;
+    }
+
+    expansion.storage.push_back(substituteParameters(body[iBody], substitutions));
+    substitutedLines.push_back(expansion.storage.back());
+  }
+}
+
+// Collects the lines up to the "endWord" closing "startWord",
+// taking nested blocks of the same kind into account.
+bool collectBlock(const vector<string_view>& codeLines, unsigned int& iLine, string_view startWord, string_view endWord, vector<string_view>& body) {
+  int depth = 1;
+  for (++iLine; iLine < codeLines.size(); ++iLine) {
+    size_t      pos  = 0;
+    string_view word = nextWord(filterComment(codeLines[iLine]), pos);
+
+    if (word == startWord)
+      depth++;
+    else if (word == endWord && --depth == 0)
+      return true;
+    body.push_back(codeLines[iLine]);
+  }
+
+  cout << "[error] Missing \"" << endWord << "\" for \"" << startWord << "\"." << endl;
+  return false;
+}
+
+bool expandLines(const vector<string_view>& codeLines, Expansion& expansion, int depth) {
+  if (depth > MAX_EXPANSION_DEPTH) {
+    cout << "[error] Macros are expanded more than " << MAX_EXPANSION_DEPTH << " levels deep, is a macro using itself?" << endl;
+    return false;
+  }
+
+  for (unsigned int iLine = 0; iLine < codeLines.size(); ++iLine) {
+    string_view codeLine = filterComment(codeLines[iLine]);
+    size_t      pos      = 0;
+    string_view word     = nextWord(codeLine, pos);
+
+    if (word == ".macro") {
+      Macro       macro;
+      string_view name = nextWord(codeLine, pos);
+
+      if (!isGoodVariableName(name) || isInstruction(name)) {
+        cout << "[error] Macro name \"" << name << "\" is not allowed!" << endl;
+        return false;
+      }
+      if (expansion.macros.find(name) != expansion.macros.end()) {
+        cout << "[error] Macro \"" << name << "\" is defined twice in the code!" << endl;
+        return false;
+      }
+
+      // Parameters, commas count as spaces
+      while (pos < codeLine.length()) {
+        size_t start = pos;
+        while (pos < codeLine.length() && !hasClass(codeLine[pos], CHAR_SPACE) && codeLine[pos] != ',')
+          pos++;
+        if (pos > start)
+          macro.parameters.push_back(codeLine.substr(start, pos - start));
+        else
+          pos++;
+      }
+      if (!collectBlock(codeLines, iLine, ".macro", ".endm", macro.body))
+        return false;
+
+      expansion.macros[name] = macro;
+      continue;
+    }
+
+    if (word == ".rep") {
+      string_view         count   = nextWord(codeLine, pos);
+      string_view         counter = nextWord(codeLine, pos);
+      string_view         first   = nextWord(codeLine, pos);
+      vector<string_view> body;
+
+      if (first == "")
+        first = "0";
+      if (count == "" || !isInt(count) || !isInt(first)) {
+        cout << "[error] \".rep\" needs a repeat count (and optionally a counter name and its first value)." << endl;
+        return false;
+      }
+      if (!collectBlock(codeLines, iLine, ".rep", ".endr", body))
+        return false;
+
+      for (int iRep = 0; iRep < toInteger(count); ++iRep) {
+        if (++expansion.count > MAX_EXPANSIONS) {
+          cout << "[error] \".rep\" blocks are repeated more than " << MAX_EXPANSIONS << " times in total." << endl;
+          return false;
+        }
+
+        map<string_view, string> substitutions;
+        vector<string_view>      repeatedLines;
+        if (counter != "")
+          substitutions[counter] = to_string(toInteger(first) + iRep);
+        substituteLines(body, substitutions, expansion, repeatedLines);
+
+        if (!expandLines(repeatedLines, expansion, depth + 1))
+          return false;
+      }
+      continue;
+    }
+
+    // Names shared with other files, for the linker
+    if (word == ".global" || word == ".extern") {
+      vector<string_view>& names = (word == ".global") ? expansion.globals : expansion.externs;
+      for (string_view name = nextWord(codeLine, pos); name != ""; name = nextWord(codeLine, pos)) {
+        if (!isGoodVariableName(name)) {
+          cout << "[error] Name \"" << name << "\" after \"" << word << "\" is not allowed!" << endl;
+          return false;
+        }
+        names.push_back(name);
+      }
+      continue;
+    }
+
+    if (word == ".endm" || word == ".endr") {
+      cout << "[error] \"" << word << "\" without a matching block." << endl;
+      return false;
+    }
+
+    if (expansion.macros.find(word) != expansion.macros.end()) {
+      Macro&              macro = expansion.macros[word];
+      vector<string_view> arguments;
+      string_view         rest  = codeLine.substr(pos);
+
+      if (rest.find(',') != string_view::npos) {
+        size_t start = 0;
+        while (start < rest.length()) {
+          size_t end = rest.find(',', start);
+          if (end == string_view::npos)
+            end = rest.length();
+          arguments.push_back(trimSpacesAndTabs(rest.substr(start, end - start)));
+          start = end + 1;
+        }
+      }
+      else {
+        size_t argumentPos = 0;
+        for (string_view argument = nextWord(rest, argumentPos); argument != ""; argument = nextWord(rest, argumentPos))
+          arguments.push_back(argument);
+      }
+
+      if (arguments.size() != macro.parameters.size()) {
+        cout << "[error] Macro \"" << word << "\" takes " << macro.parameters.size() << " arguments, but " << arguments.size() << " are given." << endl;
+        return false;
+      }
+
+      if (expansion.count >= MAX_EXPANSIONS) {
+        cout << "[error] Macros are used more than " << MAX_EXPANSIONS << " times in total." << endl;
+        return false;
+      }
+
+      map<string_view, string> substitutions;
+      vector<string_view>      macroLines;
+      for (unsigned int iParam = 0; iParam < macro.parameters.size(); ++iParam)
+        substitutions[macro.parameters[iParam]] = string(arguments[iParam]);
+      substitutions["@"] = to_string(expansion.count++);
+      substituteLines(macro.body, substitutions, expansion, macroLines);
+
+      if (!expandLines(macroLines, expansion, depth + 1))
+        return false;
+      continue;
+    }
+
+    if (depth > 0 && ++expansion.lineCount > MAX_EXPANSIONS) {
+      cout << "[error] Macros & .rep blocks make more than " << MAX_EXPANSIONS << " lines." << endl;
+      return false;
+    }
+    expansion.lines.push_back(codeLines[iLine]);
+  }
+  return true;
+}
+
+bool expandCode(string_view source, Expansion& expansion) {
+  vector<string_view> sourceLines;
+
+  expansion.count     = 0;
+  expansion.lineCount = 0;
+  splitLines(source, sourceLines);
+  if (!expandLines(sourceLines, expansion, 0))
+    return false;
+
+  if (expansion.count > 0)
+    cout << "[debug] Expanded " << expansion.macros.size() << " macros & the .rep blocks " << expansion.count << " times." << endl;
+  return true;
+}
+
+// Extended ISA: whether the instruction of the line can take its
+// argument in its low 4 bits. Only numbers & tags count, variables
+// get their address later.
+inline bool canLineBeShort(string_view codeLine, const SymbolTable& variableMap) {
+  size_t pos = 0;
+  string_view opcode           = nextWord(codeLine, pos);
+  string_view argument         = nextWord(codeLine, pos);
+  string_view optionalOperator = nextWord(codeLine, pos);
+  string_view optionalArgument = nextWord(codeLine, pos);
+
+  int       bytecode;
+  long long value;
+  return findSymbol(code, opcode, bytecode)
+      && getArgumentValue(argument, optionalOperator, optionalArgument, variableMap, value)
+      && canBeShort(bytecode, value & 0xff);
+}
+
+/* Short forms take 1 byte instead of 2, moving the tags after them,
+   which may let more instructions be short. Starts from long forms
+   & shrinks until nothing changes. An instruction that no longer
+   fits once tags moved stays long for good, so this always ends. */
+void placeShortForms(const vector<string_view>& codeLines, vector<pair<string_view, int> >& tags,
+                     const vector<unsigned int>& tagLines, SymbolTable& variableMap, ProgramInfo& info) {
+  vector<bool> isLongOnly(codeLines.size(), false);
+  info.isShortLine.assign(codeLines.size(), false);
+
+  // Tags of an object move when it is linked, only numbers are known.
+  SymbolTable        noSymbols;
+  const SymbolTable& knownSymbols = (info.object != NULL) ? noSymbols : variableMap;
+
+  for (bool isChanged = true; isChanged; ) {
+    isChanged = false;
+    for (unsigned int iLine = 0; iLine < codeLines.size(); ++iLine) {
+      if (isLongOnly[iLine])
+        continue;
+
+      bool isShort = canLineBeShort(filterComment(codeLines[iLine]), knownSymbols);
+      if (isShort != info.isShortLine[iLine]) {
+        isLongOnly[iLine]       = !isShort;
+        info.isShortLine[iLine] = isShort;
+        isChanged = true;
+      }
+    }
+
+    unsigned int iTag     = 0;
+    unsigned int tagPlace = 0;
+    for (unsigned int iLine = 0; iLine < codeLines.size(); ++iLine) {
+      if (iTag < tagLines.size() && tagLines[iTag] == iLine) {
+        tags[iTag].second = tagPlace;
+        setSymbol(variableMap, tags[iTag].first, tagPlace);
+        iTag++;
+        continue;
+      }
+
+      size_t pos = 0;
+      string_view codeLine = filterComment(codeLines[iLine]);
+      if (nextWord(codeLine, pos) != "")
+        tagPlace++;
+      if (nextWord(codeLine, pos) != "" && !info.isShortLine[iLine])
+        tagPlace++;
+    }
+  }
+}
+
+bool compileTags(const vector<string_view>& codeLines, SymbolTable& variableMap, ProgramInfo& info) {
   /* Part of code */
-  stringstream ssin;  // Parse int & strings
-  string codeLine;    // One code line
-  string opcode;      // Opcode
-  string argument;    // Argument
-  string tag;         // Tag
+  string_view codeLine;   // One code line
+  string_view opcode;     // Opcode
+  string_view argument;   // Argument
+  string_view tag;        // Tag
 
   /* Tag */
-  vector<string> tagNames;        // List of tags' name
-  unsigned int   tagPlace = 0;    // Position of tag in code.
+  vector<pair<string_view, int> > tags;   // List of tags & their place
+  vector<unsigned int> tagLines;          // Line of each tag
+  vector<int>          tagBounds;         // Loop bound of each tag
+  unsigned int tagPlace = 0;              // Position of tag in code.
 
   // Setting up tag
-  while (getline(codeFile, codeLine)) {
-    /* filter comments and 
-       setup stringstream */ 
-    filterComment(codeLine);     
-    ssin.clear();
-    ssin.str(codeLine);
-
-    opcode = "";
-    argument = "";
-    ssin >> opcode;
-    ssin >> argument;
-
-    if (opcode == "") 
+  for (unsigned int iLine = 0; iLine < codeLines.size(); ++iLine) {
+    /* keep loop bound annotation, then
+       filter comments and split words */
+    int loopBound = getLoopBound(codeLines[iLine]);
+    codeLine = filterComment(codeLines[iLine]);
+
+    size_t pos = 0;
+    opcode   = nextWord(codeLine, pos);
+    argument = nextWord(codeLine, pos);
+
+    if (opcode == "")
       continue;
 
-    /* add tag to the list of variables */ 
-    if (isTag(opcode)) { 
+    /* add tag to the list of variables */
+    if (isTag(opcode)) {
       tag = opcode.substr(0, opcode.length() - 1);
       if (!isGoodVariableName(tag)) {
         cout << "[error] Tag name \"" << tag << "\" is not allowed! (allowed characters: lowercase/uppercase characters, digits, _, $)" << endl;
         return false;
       }
-      
+
       if (isVariableExists(tag, variableMap)) {
         cout << "[error] Tag \"" << tag << "\" is repeated twice in the code!" << endl;
         return false;
@@ -211,56 +742,66 @@ bool compileTags(fstream& codeFile, map<string, int>& variableMap) {
         return false;
       }
 
-      variableMap[tag] = tagPlace;
-      tagNames.push_back(tag);
+      setSymbol(variableMap, tag, tagPlace);
+      tags.push_back(make_pair(tag, tagPlace));
+      tagLines.push_back(iLine);
+      tagBounds.push_back(loopBound);
       continue;
     }
 
-    /* increment pointers to actual data */ 
-    if (opcode != "") 
+    /* increment pointers to actual data */
+    if (opcode != "")
       tagPlace++;
-    if (argument != "") 
+    if (argument != "")
       tagPlace++;
   }
 
+  if (ExtendedISA)
+    placeShortForms(codeLines, tags, tagLines, variableMap, info);
+
+  for (unsigned int iTag = 0; iTag < tags.size(); ++iTag) {
+    if (info.tagNames.find(tags[iTag].second) == info.tagNames.end())
+      info.tagNames[tags[iTag].second] = string(tags[iTag].first);
+    if (tagBounds[iTag] > 0)
+      info.loopBounds[tags[iTag].second] = tagBounds[iTag];
+    info.tags.push_back(make_pair(string(tags[iTag].first), tags[iTag].second));
+  }
+
   // Get statistic
-  if (tagNames.size() > 0)
+  if (tags.size() > 0)
     cout << "[debug] Added following tags..." << endl;
-  for (unsigned int iName = 0; iName < tagNames.size(); ++iName)
-    cout << "    [+] " << tagNames[iName] << ": " << toBinaryString(variableMap[tagNames[iName]], 8) << " (" << variableMap[tagNames[iName]] << ")" << endl;
+  for (unsigned int iName = 0; iName < tags.size(); ++iName)
+    cout << "    [+] " << tags[iName].first << ": " << toBinaryString(tags[iName].second, 8) << " (" << tags[iName].second << ")" << endl;
   return true;
 }
 
-bool compileInstructions(fstream& codeFile, map<string, int>& variableMap, vector<int>& InitRAMContent) {
+bool compileInstructions(const vector<string_view>& codeLines, SymbolTable& variableMap, const SymbolTable& externMap,
+                         vector<int>& InitRAMContent, ProgramInfo& info) {
   cout << "[debug] Compiling the instructions..." << endl;
 
   /* Part of code */
-  stringstream ssin;          // Parse int & strings
-  string codeLine;            // One code line
-  string opcode;              // Opcode
-  string argument;            // Argument
-  string optionalOperator;    // We can add +, - , * first argument
-  string optionalArgument;    // with a 2nd argument
-  string tag;                 // Tag
+  string_view codeLine;           // One code line
+  string_view opcode;             // Opcode
+  string_view argument;           // Argument
+  string_view optionalOperator;   // We can add +, - , * first argument
+  string_view optionalArgument;   // with a 2nd argument
 
   /* Instructions generators */
-  unsigned int stackReg = 0xff;   // Store variables created in memory
-  vector<string> variableNames;   // List of variables' name
+  unsigned int stackReg = 0xff;                  // Store variables created in memory
+  vector<pair<string_view, int> > variables;     // List of variables & their address
+  SymbolTable variableSet;                       // The same, to tell them from tags
+  bool isPrologue = true;                        // No tag yet, so run once
+  int  ldiOperand = -1;                          // Of an LDI just before, for initializers
 
   // Getting data
-  while (getline(codeFile, codeLine)) {
-    filterComment(codeLine);
-    ssin.clear();
-    ssin.str(codeLine);
-
-    opcode = "";
-    argument = "";
-    optionalOperator = "";
-    optionalArgument = "";
-    ssin >> opcode;
-    ssin >> argument;
-    ssin >> optionalOperator;
-    ssin >> optionalArgument;
+  for (unsigned int iLine = 0; iLine < codeLines.size(); ++iLine) {
+    codeLine = filterComment(codeLines[iLine]);
+
+    size_t pos = 0;
+    opcode           = nextWord(codeLine, pos);
+    argument         = nextWord(codeLine, pos);
+    optionalOperator = nextWord(codeLine, pos);
+    optionalArgument = nextWord(codeLine, pos);
 
     // Empty line.
     if (opcode == "") {
@@ -278,120 +819,143 @@ bool compileInstructions(fstream& codeFile, map<string, int>& variableMap, vecto
         return false;
       }
 
-      InitRAMContent.push_back(toInteger(opcode));
+      int rawData = toInteger(opcode);
+      if (rawData > 255)
+        cout << "[warning] Raw data " << rawData << " does not fit in a byte, keeping " << (rawData & 0xff) << "." << endl;
+      InitRAMContent.push_back(rawData & 0xff);
       continue;
     }
 
     // Skip tags
     if (isTag(opcode)) {
+      isPrologue = false;
       continue;
     }
-    
+
     // Throw error if user
     // has bogus opcode :p
-    if (!isInstruction(opcode)) {
+    int bytecode;
+    if (!findSymbol(code, opcode, bytecode)) {
       cout << "[error] Instruction not recognized (opcode: " << opcode << ")." << endl;
       return false;
     }
 
     // Write bytecode to memory
-    InitRAMContent.push_back(code[opcode]);
+    info.instructionAddresses.push_back(InitRAMContent.size());
+    InitRAMContent.push_back(bytecode);
 
-    int variableAddress = 0;
+    int previousLDIOperand = ldiOperand;
+    ldiOperand = -1;
+
+    int variableAddressInMap = 0;
+    long long variableAddress = 0;
     int iOptionalArgument = 0;
-    switch (code[opcode]) {
-      /* 1 argument required (with 2 optional ones). */
-      case LDA:
-      case ADD:
-      case SUB:
-      case STA:
-      case LDI:
-      case JMP:
-      case JC:
-      case JZ:
-      case AEI:
-      case SEI:
-      case SHL:
-        if (argument == "") {
-          cout << "[error] Instruction \"" << opcode << "\" requires an argument." << endl;
+    int relocationKind = -1;      // none, the argument is a number
+    /* 1 argument required (with 2 optional ones). */
+    if (hasOperand(bytecode)) {
+      if (argument == "") {
+        cout << "[error] Instruction \"" << opcode << "\" requires an argument." << endl;
+        return false;
+      }
+
+      /*  if argument is not integer,
+          meaning it could be a string variable,
+          convert it to address then
+          write address to RAM. */
+      if (isInt(argument)) {
+        variableAddress = toInteger(argument);
+      }
+      else if (!findSymbol(variableMap, argument, variableAddressInMap)) {
+        // check if variable name is allowed
+        if (!isGoodVariableName(argument)) {
+          cout << "[error] Variable name \"" << argument << "\" is not allowed! (allowed characters: lowercase/uppercase characters, digits, _, $)" << endl;
           return false;
         }
 
-        /*  if argument is not integer,
-            meaning it could be a string variable,
-            convert it to address then 
-            write address to RAM. */
-        if (isInt(argument)) {
-          variableAddress = toInteger(argument);
-        }
-        else if (!isVariableExists(argument, variableMap)) {
-          // check if variable name is allowed
-          if (!isGoodVariableName(argument)) {
-            cout << "[error] Variable name \"" << argument << "\" is not allowed! (allowed characters: lowercase/uppercase characters, digits, _, $)" << endl;
-            return false;
-          }
-
-          // check if there are too many variables
-          if (stackReg <= InitRAMContent.size() || stackReg == 0) {
-            cout << "[error] Don't have more memory to generate more variables!" << endl;
-            return false;
-          }
-
-          // generate address & map variable name to it.
-          variableAddress = stackReg--;
-          variableMap[argument] = variableAddress;
-          variableNames.push_back(argument);
+        // check if there are too many variables
+        if (stackReg <= InitRAMContent.size() || stackReg == 0) {
+          cout << "[error] Don't have more memory to generate more variables!" << endl;
+          return false;
         }
-        else {
-          variableAddress = variableMap[argument];
+
+        // generate address & map variable name to it.
+        variableAddress = stackReg--;
+        setSymbol(variableMap, argument, variableAddress);
+        variables.push_back(make_pair(argument, variableAddress));
+        setSymbol(variableSet, argument, variableAddress);
+        relocationKind = RELOC_VARIABLE;
+      }
+      else {
+        variableAddress = variableAddressInMap;
+        if (isVariableExists(argument, variableSet))
+          relocationKind = RELOC_VARIABLE;
+        else if (isVariableExists(argument, externMap))
+          relocationKind = RELOC_EXTERN;
+        else
+          relocationKind = RELOC_CODE;
+      }
+
+      /*  get optional operator & argument */
+      if (optionalOperator != "") {
+        if (!isGoodOptionalOperator(optionalOperator)) {
+          cout << "[error] Optional operator should only be +, - or *!" << endl;
+          return false;
         }
 
-        /*  get optional operator & argument */
-        if (optionalOperator != "") {
-          if (!isGoodOptionalOperator(optionalOperator)) {
-            cout << "[error] Optional operator should only be +, - or *!" << endl;
-            return false;
-          }
-
-          if (optionalArgument == "") {
-            cout << "[error] Optional argument required!" << endl;
-            return false;
-          }
-
-          if (!isInt(optionalArgument)) {
-            cout << "[error] Optional argument must be an integer!" << endl;
-            return false;
-          }
-
-          iOptionalArgument = toInteger(optionalArgument);
-          switch (optionalOperator[0]) {
-            case '+':
-              variableAddress += iOptionalArgument;
-              break;
-            case '-':
-              variableAddress -= iOptionalArgument;
-              break;
-            case '*':
-              variableAddress *= iOptionalArgument;
-              break;
-          }
+        if (optionalArgument == "") {
+          cout << "[error] Optional argument required!" << endl;
+          return false;
         }
 
-        // write address to RAM.
-        InitRAMContent.push_back(variableAddress);
-        break;
+        if (!isInt(optionalArgument)) {
+          cout << "[error] Optional argument must be an integer!" << endl;
+          return false;
+        }
 
-      /* 0 argument required. */
-      case NOP:
-      case HLT:
-      case _OUT:
-      case SLF:
-        if (argument != "") {
-          cout << "[error] Argument doesn't exist for this instruction \"" << opcode << "\"." << endl;
+        // The linker only adds to addresses
+        if (info.object != NULL && optionalOperator[0] == '*') {
+          cout << "[error] The address of \"" << argument << "\" is only known once linked, it cannot be multiplied." << endl;
           return false;
         }
 
-        break;
+        iOptionalArgument = toInteger(optionalArgument);
+        switch (optionalOperator[0]) {
+          case '+':
+            variableAddress += iOptionalArgument;
+            break;
+          case '-':
+            variableAddress -= iOptionalArgument;
+            break;
+          case '*':
+            variableAddress *= iOptionalArgument;
+            break;
+        }
+      }
+
+      // write address to RAM, wrapping around like
+      // the 8-bit registers ("end_of_stack + 1" is 0).
+      // Short forms have it in the opcode instead.
+      if (ExtendedISA && info.isShortLine[iLine])
+        InitRAMContent.back() |= variableAddress & 0x0f;
+      else
+        InitRAMContent.push_back(variableAddress & 0xff);
+
+      // Objects only have short forms of numbers
+      if (info.object != NULL && relocationKind >= 0)
+        info.object->relocations.push_back({ (int)InitRAMContent.size() - 1, relocationKind, string(argument) });
+
+      /* "LDI n / STA x" before the first tag gives x its first
+         value, "run --set x=..." changes n with it. */
+      if (bytecode == LDI && relocationKind < 0 && !(ExtendedISA && info.isShortLine[iLine]))
+        ldiOperand = InitRAMContent.size() - 1;
+      else if (bytecode == STA && isPrologue && previousLDIOperand >= 0 && relocationKind == RELOC_VARIABLE
+               && optionalOperator == "" && info.initializers.find(string(argument)) == info.initializers.end())
+        info.initializers[string(argument)] = previousLDIOperand;
+    }
+    /* 0 argument required. */
+    else if (argument != "") {
+      cout << "[error] Argument doesn't exist for this instruction \"" << opcode << "\"." << endl;
+      return false;
     }
   }
 
@@ -401,45 +965,532 @@ bool compileInstructions(fstream& codeFile, map<string, int>& variableMap, vecto
     return false;
   }
 
+  // Variables were placed below 0xff while the code was
+  // still shorter, the code may have grown over them since.
+  if (stackReg + 1 < InitRAMContent.size()) {
+    cout << "[error] Code is " << InitRAMContent.size() << " bytes long, it overwrites the variables placed from address " << stackReg + 1 << "." << endl;
+    return false;
+  }
+
   // Add the remaining memory space to fill up 256 blocks of memory
+  info.codeSize = InitRAMContent.size();
   for (int block = InitRAMContent.size(); block < 256; ++block)
     InitRAMContent.push_back(0);
 
   // Notify the user about variables automatically added (if have)
-  if (variableNames.size() > 0)
+  if (variables.size() > 0)
     cout << "[debug] Added variables: " << endl;
-  for (unsigned int iName = 0; iName < variableNames.size(); ++iName)
-    cout << "    [+] " << variableNames[iName] << ": " << toBinaryString(variableMap[variableNames[iName]], 8) << " (" << variableMap[variableNames[iName]] << ")" << endl;
+  for (unsigned int iName = 0; iName < variables.size(); ++iName)
+    cout << "    [+] " << variables[iName].first << ": " << toBinaryString(variables[iName].second, 8) << " (" << variables[iName].second << ")" << endl;
+
+  for (unsigned int iName = 0; iName < variables.size(); ++iName)
+    info.variables.push_back(make_pair(string(variables[iName].first), variables[iName].second));
   return true;
 }
 
-bool compileCodeFile(string filename, vector<int>& InitRAMContent) {
-  cout << "[debug] Compiling the code..." << endl;
+// What an object keeps besides its tags, variables & relocations.
+bool saveObject(const Expansion& expansion, const SymbolTable& variableMap, const SymbolTable& externMap,
+                const vector<int>& InitRAMContent, ProgramInfo& info) {
+  ObjectFile& object = *info.object;
 
-  /* Code file */
-  fstream codeFile;
+  for (unsigned int iName = 0; iName < expansion.globals.size(); ++iName) {
+    string_view name = expansion.globals[iName];
+    if (!isVariableExists(name, variableMap) || isVariableExists(name, externMap)) {
+      cout << "[error] \".global " << name << "\" but this file has no tag or variable \"" << name << "\"." << endl;
+      return false;
+    }
+    if (find(object.globals.begin(), object.globals.end(), name) == object.globals.end())
+      object.globals.push_back(string(name));
+  }
+
+  object.isExtended           = ExtendedISA;
+  object.code                 = vector<int>(InitRAMContent.begin(), InitRAMContent.begin() + info.codeSize);
+  object.instructionAddresses = info.instructionAddresses;
+  object.loopBounds           = info.loopBounds;
+  object.tags                 = info.tags;
+  object.variables            = info.variables;
+  object.initializers         = info.initializers;
+  return true;
+}
 
+// "source" has to outlive the call, names are views into it.
+bool compileCode(string_view source, vector<int>& InitRAMContent, ProgramInfo& info) {
   /* Map of variable names -> 8-bit addresses */
-  map<string, int> variableMap;
+  SymbolTable variableMap;
 
-  codeFile.open(filename, fstream::in);
-  if (!codeFile) {
-    cout << "[error] No such file \"" << filename << "\" is found." << endl;
+  // Expand macros & .rep blocks
+  // into plain lines of code
+  Expansion expansion;
+  if (!expandCode(source, expansion))
+    return false;
+
+  if (!expansion.externs.empty() && info.object == NULL) {
+    cout << "[error] \".extern " << expansion.externs[0] << "\" only works in object files (--object or --link)." << endl;
     return false;
   }
 
   // Convert tag into addresses
-  if (!compileTags(codeFile, variableMap))
+  if (!compileTags(expansion.lines, variableMap, info))
     return false;
 
-  codeFile.clear();
-  codeFile.seekg(0);
+  // Names from other files, at 0 until linked
+  SymbolTable externMap;
+  for (unsigned int iName = 0; iName < expansion.externs.size(); ++iName) {
+    string_view name = expansion.externs[iName];
+    if (isVariableExists(name, externMap))
+      continue;
+    if (isVariableExists(name, variableMap)) {
+      cout << "[error] \"" << name << "\" is a tag of this file, it cannot be extern." << endl;
+      return false;
+    }
+    setSymbol(variableMap, name, 0);
+    setSymbol(externMap, name, 0);
+    info.object->externs.push_back(string(name));
+  }
 
   // Put code -> RAM;
   // Convert variable names into addresses
-  if (!compileInstructions(codeFile, variableMap, InitRAMContent))
+  if (!compileInstructions(expansion.lines, variableMap, externMap, InitRAMContent, info))
+    return false;
+
+  if (info.object != NULL)
+    return saveObject(expansion, variableMap, externMap, InitRAMContent, info);
+  return true;
+}
+
+bool compileCodeFile(string filename, vector<int>& InitRAMContent, ProgramInfo& info) {
+  cout << "[debug] Compiling the code..." << endl;
+
+  /* Code file */
+  SourceFile source;
+  if (!openSourceFile(filename, source)) {
+    cout << "[error] No such file \"" << filename << "\" is found." << endl;
     return false;
+  }
+
+  bool isCompiled = compileCode(string_view(source.data, source.size), InitRAMContent, info);
+  closeSourceFile(source);
+  return isCompiled;
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////
+//                                   ANALYSIS FUNCTIONS
+//////////////////////////////////////////////////////////////////////////////////////////////
+
+const long long UNBOUNDED_CYCLES = 1LL << 60;
+
+struct BasicBlock {
+  int          start;           // address of the first instruction
+  vector<int>  instructions;    // address of every instruction
+  long long    cycles;          // without the conditional jump ending it
+  vector<int>  successors;      // block indices
+  vector<int>  edgeCycles;      // cycles spent taking each successor
+  bool         halts;           // HLT or unknown opcode ends it
+};
+
+struct Loop {
+  int          header;          // block index
+  vector<bool> body;            // block index -> in the loop?
+  int          blockCount;
+  int          depth;
+  int          bound;           // -1 when not annotated
+  long long    iterationCycles;
+};
+
+string getAddressName(int address, ProgramInfo& info) {
+  stringstream ssout;
+  ssout << "0x" << hex << (address >> 4) << (address & 0xf);
+  if (info.tagNames.find(address) != info.tagNames.end())
+    return info.tagNames[address] + " (" + ssout.str() + ")";
+  return ssout.str();
+}
+
+inline long long addCycles(long long a, long long b) {
+  return (a >= UNBOUNDED_CYCLES || b >= UNBOUNDED_CYCLES) ? UNBOUNDED_CYCLES : a + b;
+}
+
+inline long long multiplyCycles(long long a, long long times) {
+  if (times == 0) return 0;
+  return (a >= UNBOUNDED_CYCLES / times) ? UNBOUNDED_CYCLES : a * times;
+}
+
+string cyclesToString(long long cycles) {
+  return cycles >= UNBOUNDED_CYCLES ? string("unbounded") : to_string(cycles);
+}
+
+/* Longest path (in cycles) from "source" to every node of
+   the region, following edges between distinct collapsed
+   nodes and never coming back to the source. Returns false
+   if the region still has a cycle (irreducible flow). */
+bool findLongestPaths(int source, vector<BasicBlock>& blocks, vector<int>& rep, vector<long long>& nodeCycles,
+                      vector<bool>& inRegion, vector<long long>& dist) {
+  int n = blocks.size();
+
+  // Edges of the collapsed graph: node -> (next node, cycles)
+  vector<vector<pair<int, int> > > edges(n);
+  for (int b = 0; b < n; ++b) {
+    if (!inRegion[b])
+      continue;
+    for (unsigned int iSucc = 0; iSucc < blocks[b].successors.size(); ++iSucc) {
+      int next = rep[blocks[b].successors[iSucc]];
+      if (inRegion[next] && next != rep[b] && next != source)
+        edges[rep[b]].push_back(make_pair(next, blocks[b].edgeCycles[iSucc]));
+    }
+  }
+
+  // Topological order with an explicit DFS stack
+  vector<int> state(n, 0);     // 0: new, 1: on stack, 2: done
+  vector<int> order;           // reverse topological order
+  stack<pair<int, unsigned int> > dfs;
+  dfs.push(make_pair(source, 0));
+  state[source] = 1;
+  while (!dfs.empty()) {
+    int node = dfs.top().first;
+    unsigned int iEdge = dfs.top().second++;
+
+    if (iEdge == edges[node].size()) {
+      state[node] = 2;
+      order.push_back(node);
+      dfs.pop();
+      continue;
+    }
+
+    int next = edges[node][iEdge].first;
+    if (state[next] == 1)
+      return false;
+    if (state[next] == 0) {
+      state[next] = 1;
+      dfs.push(make_pair(next, 0));
+    }
+  }
+
+  // Relax in topological order
+  dist.assign(n, -1);
+  dist[source] = nodeCycles[source];
+  for (int iOrder = order.size() - 1; iOrder >= 0; --iOrder) {
+    int node = order[iOrder];
+    for (unsigned int iEdge = 0; iEdge < edges[node].size(); ++iEdge) {
+      int next = edges[node][iEdge].first;
+      long long candidate = addCycles(addCycles(dist[node], edges[node][iEdge].second), nodeCycles[next]);
+      dist[next] = max(dist[next], candidate);
+    }
+  }
+  return true;
+}
+
+// The instruction at <address>: its opcode without a short operand,
+// where the next one starts & where it would jump.
+inline int decodeInstruction(vector<int>& InitRAMContent, int address, int& next, int& target) {
+  int bytecode = InitRAMContent[address];
+  next   = (address + (hasOperand(bytecode, ExtendedISA) ? 2 : 1)) & 0xff;
+  target = isShortForm(bytecode, ExtendedISA) ? (bytecode & 0x0f) : InitRAMContent[(address + 1) & 0xff];
+  return getBaseOpcode(bytecode, ExtendedISA);
+}
+
+bool analyzeProgram(vector<int>& InitRAMContent, ProgramInfo& info) {
+  cout << "[debug] Analyzing control flow..." << endl;
+
+  vector<bool> isReached(256, false);     // instruction starts reachable from 0
+  vector<bool> isLeader(256, false);
+  vector<bool> isAssembled(256, false);   // instruction starts from the source
+  stack<int>   toVisit;
+  bool         isIncomplete = false;      // some jump target is patched at runtime
+
+  for (unsigned int i = 0; i < info.instructionAddresses.size(); ++i)
+    isAssembled[info.instructionAddresses[i]] = true;
+
+  /* Decode every instruction reachable from address 0 */
+  isLeader[0] = true;
+  toVisit.push(0);
+  while (!toVisit.empty()) {
+    int address = toVisit.top();
+    toVisit.pop();
+    if (isReached[address])
+      continue;
+    isReached[address] = true;
+
+    int next, target;
+    int opcode = decodeInstruction(InitRAMContent, address, next, target);
+
+    if (!isKnownOpcode(InitRAMContent[address], ExtendedISA) || opcode == HLT)
+      continue;
+
+    if (opcode == JMP || opcode == JC || opcode == JZ) {
+      isLeader[target] = true;
+      toVisit.push(target);
+      if (opcode == JMP)
+        continue;
+      isLeader[next] = true;
+    }
+    toVisit.push(next);
+  }
+
+  /* Cut instructions into basic blocks */
+  vector<BasicBlock> blocks;
+  vector<int>        blockAt(256, -1);
+  for (int address = 0; address < 256; ++address) {
+    if (isReached[address] && isLeader[address]) {
+      blockAt[address] = blocks.size();
+      blocks.push_back(BasicBlock());
+      blocks.back().start = address;
+    }
+  }
+
+  for (unsigned int iBlock = 0; iBlock < blocks.size(); ++iBlock) {
+    BasicBlock &block = blocks[iBlock];
+    int address = block.start;
+    block.cycles = 0;
+    block.halts  = false;
+
+    while (true) {
+      int next, target;
+      int opcode   = decodeInstruction(InitRAMContent, address, next, target);
+      int bytecode = InitRAMContent[address];
+      block.instructions.push_back(address);
+
+      if (!isKnownOpcode(bytecode, ExtendedISA) || opcode == HLT) {
+        block.cycles += getInstructionCycles(bytecode, false, ExtendedISA);
+        block.halts = true;
+        break;
+      }
+      if (opcode == JMP) {
+        block.cycles += getInstructionCycles(bytecode, true, ExtendedISA);
+        block.successors.push_back(blockAt[target]);
+        block.edgeCycles.push_back(0);
+        break;
+      }
+      if (opcode == JC || opcode == JZ) {
+        block.successors.push_back(blockAt[target]);
+        block.edgeCycles.push_back(getInstructionCycles(bytecode, true, ExtendedISA));
+        block.successors.push_back(blockAt[next]);
+        block.edgeCycles.push_back(getInstructionCycles(bytecode, false, ExtendedISA));
+        break;
+      }
+
+      block.cycles += getInstructionCycles(bytecode, false, ExtendedISA);
+      if (isLeader[next]) {
+        block.successors.push_back(blockAt[next]);
+        block.edgeCycles.push_back(0);
+        break;
+      }
+      address = next;
+    }
+  }
+
+  int n = blocks.size();
+  cout << "[debug] Basic blocks:" << endl;
+  for (int b = 0; b < n; ++b) {
+    BasicBlock &block = blocks[b];
+    int last = block.instructions.back();
+    cout << "    [+] " << getAddressName(block.start, info) << ": " << block.instructions.size() << " instructions, "
+         << block.cycles;
+    if (block.edgeCycles.size() == 2)
+      cout << " + " << block.edgeCycles[0] << " (" << getMnemonic(InitRAMContent[last], ExtendedISA) << " taken) / "
+           << block.edgeCycles[1] << " (not taken)";
+    cout << " cycles";
+    if (block.halts)
+      cout << ", " << (InitRAMContent[last] == HLT ? "halts" : "stops on unknown opcode");
+    for (unsigned int iSucc = 0; iSucc < block.successors.size(); ++iSucc)
+      cout << (iSucc == 0 ? " -> " : ", ") << getAddressName(blocks[block.successors[iSucc]].start, info);
+    cout << endl;
+  }
+
+  /* Unreachable code & self-modifying code */
+  vector<bool> isComputedStore(256, false);
+  for (unsigned int i = 0; i < info.instructionAddresses.size(); ++i) {
+    int address = info.instructionAddresses[i];
+    if (!isReached[address])
+      cout << "[warning] Unreachable code at " << getAddressName(address, info) << ": "
+           << getMnemonic(InitRAMContent[address], ExtendedISA) << endl;
+  }
+
+  for (int address = 0; address < 256; ++address) {
+    if (!isReached[address])
+      continue;
+    if (!isAssembled[address] && address < info.codeSize)
+      cout << "[warning] Raw data at " << getAddressName(address, info) << " is executed as code." << endl;
+    if (InitRAMContent[address] != STA)
+      continue;
+
+    int written = InitRAMContent[(address + 1) & 0xff];
+    for (int patched = 0; patched < 256; ++patched) {
+      int patchedOpcode = getBaseOpcode(InitRAMContent[patched], ExtendedISA);
+      if (!isReached[patched])
+        continue;
+
+      if (patched == written)
+        cout << "[warning] STA at " << getAddressName(address, info) << " patches the opcode at "
+             << getAddressName(patched, info) << ", analysis may not match the run." << endl;
+      else if (hasOperand(InitRAMContent[patched], ExtendedISA) && ((patched + 1) & 0xff) == written) {
+        cout << "[warning] STA at " << getAddressName(address, info) << " patches the operand of "
+             << getMnemonic(patchedOpcode) << " at " << getAddressName(patched, info) << "." << endl;
+        if (patchedOpcode == JMP || patchedOpcode == JC || patchedOpcode == JZ)
+          isIncomplete = true;
+        if (patchedOpcode == STA)
+          isComputedStore[patched] = true;
+      }
+    }
+  }
+
+  for (int address = 0; address < 256; ++address)
+    if (isComputedStore[address])
+      cout << "[warning] STA at " << getAddressName(address, info) << " writes to a computed address, "
+           << "it may patch code anywhere." << endl;
+
+  /* Dominators */
+  vector<vector<int> > predecessors(n);
+  for (int b = 0; b < n; ++b)
+    for (unsigned int iSucc = 0; iSucc < blocks[b].successors.size(); ++iSucc)
+      predecessors[blocks[b].successors[iSucc]].push_back(b);
+
+  vector<vector<bool> > dominators(n, vector<bool>(n, true));
+  dominators[0].assign(n, false);
+  dominators[0][0] = true;
+  for (bool isChanged = true; isChanged; ) {
+    isChanged = false;
+    for (int b = 1; b < n; ++b) {
+      vector<bool> newDominators(n, true);
+      for (unsigned int iPred = 0; iPred < predecessors[b].size(); ++iPred)
+        for (int d = 0; d < n; ++d)
+          newDominators[d] = newDominators[d] && dominators[predecessors[b][iPred]][d];
+      newDominators[b] = true;
+      if (newDominators != dominators[b]) {
+        dominators[b] = newDominators;
+        isChanged = true;
+      }
+    }
+  }
+
+  /* Natural loops: one per header, merging its back edges */
+  vector<Loop> loops;
+  for (int h = 0; h < n; ++h) {
+    Loop loop;
+    loop.header = h;
+    loop.body.assign(n, false);
+    loop.body[h] = true;
+
+    stack<int> toMark;
+    for (unsigned int iPred = 0; iPred < predecessors[h].size(); ++iPred)
+      if (dominators[predecessors[h][iPred]][h])
+        toMark.push(predecessors[h][iPred]);
+    if (toMark.empty())
+      continue;
+
+    while (!toMark.empty()) {
+      int b = toMark.top();
+      toMark.pop();
+      if (loop.body[b])
+        continue;
+      loop.body[b] = true;
+      for (unsigned int iPred = 0; iPred < predecessors[b].size(); ++iPred)
+        toMark.push(predecessors[b][iPred]);
+    }
+
+    loop.blockCount = count(loop.body.begin(), loop.body.end(), true);
+    loop.bound = -1;
+    if (info.loopBounds.find(blocks[h].start) != info.loopBounds.end())
+      loop.bound = info.loopBounds[blocks[h].start];
+    loops.push_back(loop);
+  }
+
+  for (unsigned int iLoop = 0; iLoop < loops.size(); ++iLoop) {
+    loops[iLoop].depth = 1;
+    for (unsigned int iOuter = 0; iOuter < loops.size(); ++iOuter)
+      if (iOuter != iLoop && loops[iOuter].body[loops[iLoop].header])
+        loops[iLoop].depth++;
+  }
+
+  /* Worst case: collapse loops from the innermost out, each
+     one costing (bound - 1) full iterations plus the longest
+     way out of it. */
+  vector<int>       rep(n);
+  vector<long long> nodeCycles(n);
+  vector<long long> dist;
+  bool              isReducible = true;
+  for (int b = 0; b < n; ++b) {
+    rep[b] = b;
+    nodeCycles[b] = blocks[b].cycles;
+  }
+
+  vector<int> loopOrder;
+  for (unsigned int iLoop = 0; iLoop < loops.size(); ++iLoop)
+    loopOrder.push_back(iLoop);
+  sort(loopOrder.begin(), loopOrder.end(), [&](int l, int r) { return loops[l].blockCount < loops[r].blockCount; });
+
+  for (unsigned int iOrder = 0; iOrder < loopOrder.size(); ++iOrder) {
+    Loop &loop = loops[loopOrder[iOrder]];
+    int   h    = loop.header;
+
+    if (!findLongestPaths(h, blocks, rep, nodeCycles, loop.body, dist)) {
+      isReducible = false;
+      break;
+    }
 
+    long long iteration = -1;
+    long long exitPath  = -1;
+    for (int b = 0; b < n; ++b) {
+      if (!loop.body[b] || dist[rep[b]] < 0)
+        continue;
+      for (unsigned int iSucc = 0; iSucc < blocks[b].successors.size(); ++iSucc) {
+        int next = blocks[b].successors[iSucc];
+        if (rep[next] == h)
+          iteration = max(iteration, addCycles(dist[rep[b]], blocks[b].edgeCycles[iSucc]));
+        else if (!loop.body[next])
+          exitPath = max(exitPath, dist[rep[b]]);
+      }
+    }
+
+    loop.iterationCycles = iteration;
+    if (loop.bound <= 0 || exitPath < 0)
+      nodeCycles[h] = UNBOUNDED_CYCLES;
+    else
+      nodeCycles[h] = addCycles(multiplyCycles(iteration, loop.bound - 1), exitPath);
+
+    for (int b = 0; b < n; ++b)
+      if (loop.body[b])
+        rep[b] = h;
+  }
+
+  if (loops.size() > 0)
+    cout << "[debug] Loops:" << endl;
+  for (unsigned int iLoop = 0; iLoop < loops.size(); ++iLoop) {
+    Loop &loop = loops[iLoop];
+    cout << "    [+] " << getAddressName(blocks[loop.header].start, info) << ": " << loop.blockCount
+         << " blocks, depth " << loop.depth << ", " << cyclesToString(loop.iterationCycles) << " cycles per iteration, ";
+    if (loop.bound > 0)
+      cout << "bound " << loop.bound;
+    else
+      cout << "no bound (add \"# @bound N\" after the tag)";
+    cout << endl;
+  }
+
+  /* Longest path from the start to any halting block */
+  long long worstCase = -1;
+  vector<bool> everything(n, true);
+  if (isReducible && !isIncomplete) {
+    if (!findLongestPaths(rep[0], blocks, rep, nodeCycles, everything, dist))
+      isReducible = false;
+  }
+
+  if (!isReducible) {
+    cout << "[warning] Control flow is irreducible, no worst case bound." << endl;
+    return true;
+  }
+  if (isIncomplete) {
+    cout << "[warning] Some jump targets are patched at runtime, no worst case bound." << endl;
+    return true;
+  }
+
+  for (int b = 0; b < n; ++b)
+    if (blocks[b].halts && dist[rep[b]] >= 0)
+      worstCase = max(worstCase, dist[rep[b]]);
+
+  if (worstCase < 0)
+    cout << "[warning] Program never halts." << endl;
+  else if (worstCase >= UNBOUNDED_CYCLES)
+    cout << "[debug] Worst case: unbounded (some loops have no bound)." << endl;
+  else
+    cout << "[debug] Worst case: " << worstCase << " cycles until HLT." << endl;
   return true;
 }
 
@@ -465,36 +1516,822 @@ bool writeInitRAMToFile(vector<int> InitRAMContent, string outputName) {
   return true;
 }
 
-string getOutputName(string inputName) {
+/* The symbol map, for "run --set <name>=<value>":
+     tag <name> <address>
+     variable <name> <address> [<address of the LDI operand giving its first value>] */
+bool writeSymbolFile(const ProgramInfo& info, string outputName) {
+  fstream outputFile;
+
+  outputFile.open(outputName, fstream::out);
+  if (!outputFile) {
+    cout << "[error] Cannot write to file \"" << outputName << "\". Permission Denied?" << endl;
+    return false;
+  }
+
+  for (unsigned int i = 0; i < info.tags.size(); ++i)
+    outputFile << "tag " << info.tags[i].first << " " << info.tags[i].second << endl;
+  for (unsigned int i = 0; i < info.variables.size(); ++i) {
+    outputFile << "variable " << info.variables[i].first << " " << info.variables[i].second;
+    if (info.initializers.find(info.variables[i].first) != info.initializers.end())
+      outputFile << " " << info.initializers.at(info.variables[i].first);
+    outputFile << endl;
+  }
+  return true;
+}
+
+string getOutputName(string inputName, string extension = ".out") {
   if (inputName.rfind(".") != string::npos) {
     unsigned int place = inputName.rfind(".");
     inputName.erase(place);
   }
-  return inputName += ".out";
+  return inputName += extension;
+}
+
+/* One record a line, the code in hex:
+     object 1 extended 0
+     code 50 07 40 ff ...
+     instructions 0 2 4 ...
+     tag <name> <offset>       bound <offset> <n>
+     variable <name> <address> init <variable> <offset>
+     global <name>             extern <name>
+     reloc <offset> code|variable|extern <name> */
+bool writeObjectFile(const ObjectFile& object, string outputName) {
+  const char* kindNames[] = { "code", "variable", "extern" };
+  fstream     outputFile;
+
+  outputFile.open(outputName, fstream::out);
+  if (!outputFile) {
+    cout << "[error] Cannot write to file \"" << outputName << "\". Permission Denied?" << endl;
+    return false;
+  }
+
+  outputFile << "object 1 extended " << object.isExtended << endl;
+  for (unsigned int i = 0; i < object.code.size(); i += 16) {
+    outputFile << "code";
+    for (unsigned int j = i; j < i + 16 && j < object.code.size(); ++j)
+      outputFile << " " << hex << setw(2) << setfill('0') << object.code[j] << dec;
+    outputFile << endl;
+  }
+  outputFile << "instructions";
+  for (unsigned int i = 0; i < object.instructionAddresses.size(); ++i)
+    outputFile << " " << object.instructionAddresses[i];
+  outputFile << endl;
+
+  for (unsigned int i = 0; i < object.tags.size(); ++i)
+    outputFile << "tag " << object.tags[i].first << " " << object.tags[i].second << endl;
+  for (auto bound = object.loopBounds.begin(); bound != object.loopBounds.end(); ++bound)
+    outputFile << "bound " << bound->first << " " << bound->second << endl;
+  for (unsigned int i = 0; i < object.variables.size(); ++i)
+    outputFile << "variable " << object.variables[i].first << " " << object.variables[i].second << endl;
+  for (auto initializer = object.initializers.begin(); initializer != object.initializers.end(); ++initializer)
+    outputFile << "init " << initializer->first << " " << initializer->second << endl;
+  for (unsigned int i = 0; i < object.globals.size(); ++i)
+    outputFile << "global " << object.globals[i] << endl;
+  for (unsigned int i = 0; i < object.externs.size(); ++i)
+    outputFile << "extern " << object.externs[i] << endl;
+  for (unsigned int i = 0; i < object.relocations.size(); ++i)
+    outputFile << "reloc " << object.relocations[i].offset << " " << kindNames[object.relocations[i].kind]
+               << " " << object.relocations[i].name << endl;
+
+  outputFile.close();
+  if (!outputFile) {
+    cout << "[error] Cannot write to file \"" << outputName << "\"." << endl;
+    return false;
+  }
+  return true;
+}
+
+bool readObjectFile(string inputName, ObjectFile& object) {
+  ifstream inputFile(inputName);
+  if (!inputFile) {
+    cout << "[error] No such file \"" << inputName << "\" is found." << endl;
+    return false;
+  }
+
+  object = ObjectFile();
+  object.fileName = inputName;
+
+  string line;
+  int    version = 0;
+  for (int iLine = 1; getline(inputFile, line); ++iLine) {
+    stringstream words(line);
+    string       record, name, kind;
+    int          number = 0, value = 0;
+    bool         isRead = true;
+
+    words >> record;
+    if (record == "object")
+      isRead = (words >> version >> kind >> object.isExtended) && version == 1 && kind == "extended";
+    else if (record == "code") {
+      while (words >> hex >> number)
+        object.code.push_back(number & 0xff);
+      isRead = words.eof();
+    }
+    else if (record == "instructions") {
+      while (words >> number)
+        object.instructionAddresses.push_back(number);
+      isRead = words.eof();
+    }
+    else if (record == "tag" && (words >> name >> number))
+      object.tags.push_back(make_pair(name, number));
+    else if (record == "bound" && (words >> number >> value))
+      object.loopBounds[number] = value;
+    else if (record == "variable" && (words >> name >> number))
+      object.variables.push_back(make_pair(name, number));
+    else if (record == "init" && (words >> name >> number))
+      object.initializers[name] = number;
+    else if (record == "global" && (words >> name))
+      object.globals.push_back(name);
+    else if (record == "extern" && (words >> name))
+      object.externs.push_back(name);
+    else if (record == "reloc" && (words >> number >> kind >> name)) {
+      int kindValue = (kind == "code") ? RELOC_CODE : (kind == "variable") ? RELOC_VARIABLE : (kind == "extern") ? RELOC_EXTERN : -1;
+      isRead = kindValue >= 0 && number >= 0;
+      object.relocations.push_back({ number, kindValue, name });
+    }
+    else
+      isRead = (record == "");
+
+    if (!isRead || version != 1) {
+      cout << "[error] Line " << iLine << " of \"" << inputName << "\" is not part of an object file." << endl;
+      return false;
+    }
+  }
+
+  for (unsigned int i = 0; i < object.relocations.size(); ++i) {
+    if (object.relocations[i].offset >= (int)object.code.size()) {
+      cout << "[error] \"" << inputName << "\" moves byte " << object.relocations[i].offset << " of its " << object.code.size() << " bytes of code." << endl;
+      return false;
+    }
+  }
+  for (auto initializer = object.initializers.begin(); initializer != object.initializers.end(); ++initializer) {
+    if (initializer->second < 0 || initializer->second >= (int)object.code.size()) {
+      cout << "[error] \"" << inputName << "\" sets \"" << initializer->first << "\" from byte " << initializer->second
+           << " of its " << object.code.size() << " bytes of code." << endl;
+      return false;
+    }
+  }
+  return true;
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////
+//                                    LINK FUNCTIONS
+//////////////////////////////////////////////////////////////////////////////////////////////
+
+/* The code of the objects one after the other from 0, in the
+   order given (the first one is where the machine starts),
+   then their variables from 0xff down, in the same order. */
+bool linkObjects(vector<ObjectFile>& objects, vector<int>& InitRAMContent, ProgramInfo& info) {
+  cout << "[debug] Linking " << objects.size() << " files..." << endl;
+
+  vector<int> codeBases;
+  int         codeEnd = 0;
+  for (unsigned int iObject = 0; iObject < objects.size(); ++iObject) {
+    codeBases.push_back(codeEnd);
+    codeEnd += objects[iObject].code.size();
+  }
+  if (codeEnd > 256) {
+    cout << "[error] Machine only has 256 addresses to store stuffs :< The code of these files is " << codeEnd << " bytes." << endl;
+    return false;
+  }
+
+  // Final address of every variable, by file
+  vector<map<string, int> > variableAddresses(objects.size());
+  int stackReg = 0xff;
+  for (unsigned int iObject = 0; iObject < objects.size(); ++iObject) {
+    for (unsigned int iName = 0; iName < objects[iObject].variables.size(); ++iName) {
+      const string& name = objects[iObject].variables[iName].first;
+      if (stackReg < codeEnd) {
+        cout << "[error] Variable \"" << name << "\" of \"" << objects[iObject].fileName << "\" would be at address "
+             << stackReg << ", inside the code (0 to " << codeEnd - 1 << ")." << endl;
+        return false;
+      }
+      variableAddresses[iObject][name] = stackReg--;
+    }
+  }
+
+  // What each file exports
+  map<string, pair<int, unsigned int> > globals;   // name -> address, file
+  for (unsigned int iObject = 0; iObject < objects.size(); ++iObject) {
+    const ObjectFile& object = objects[iObject];
+    for (unsigned int iName = 0; iName < object.globals.size(); ++iName) {
+      const string& name    = object.globals[iName];
+      int           address = -1;
+      for (unsigned int iTag = 0; iTag < object.tags.size() && address < 0; ++iTag) {
+        if (object.tags[iTag].first == name)
+          address = codeBases[iObject] + object.tags[iTag].second;
+      }
+      if (address < 0 && variableAddresses[iObject].count(name) > 0)
+        address = variableAddresses[iObject][name];
+      if (address < 0) {
+        cout << "[error] \"" << object.fileName << "\" exports \"" << name << "\" but has no tag or variable of that name." << endl;
+        return false;
+      }
+
+      if (globals.find(name) != globals.end()) {
+        cout << "[error] \"" << name << "\" is exported by both \"" << objects[globals[name].second].fileName
+             << "\" and \"" << object.fileName << "\"." << endl;
+        return false;
+      }
+      globals[name] = make_pair(address, iObject);
+    }
+  }
+
+  // Private names taken by more than one file are
+  // "<file>.<name>" in the symbol map.
+  map<string, int> nameCounts;
+  for (unsigned int iObject = 0; iObject < objects.size(); ++iObject) {
+    set<string> names;
+    for (unsigned int iTag = 0; iTag < objects[iObject].tags.size(); ++iTag)
+      names.insert(objects[iObject].tags[iTag].first);
+    for (unsigned int iName = 0; iName < objects[iObject].variables.size(); ++iName)
+      names.insert(objects[iObject].variables[iName].first);
+    for (auto name = names.begin(); name != names.end(); ++name)
+      nameCounts[*name]++;
+  }
+
+  // Move every object in place
+  InitRAMContent.assign(256, 0);
+  for (unsigned int iObject = 0; iObject < objects.size(); ++iObject) {
+    const ObjectFile& object = objects[iObject];
+    int               base   = codeBases[iObject];
+    for (unsigned int i = 0; i < object.code.size(); ++i)
+      InitRAMContent[base + i] = object.code[i];
+
+    for (unsigned int iReloc = 0; iReloc < object.relocations.size(); ++iReloc) {
+      const Relocation& relocation = object.relocations[iReloc];
+      int               delta      = base;
+      if (relocation.kind == RELOC_VARIABLE) {
+        auto assembled = find_if(object.variables.begin(), object.variables.end(),
+                                 [&relocation](const pair<string, int>& variable) { return variable.first == relocation.name; });
+        if (assembled == object.variables.end()) {
+          cout << "[error] \"" << object.fileName << "\" moves the address of \"" << relocation.name << "\", which is none of its variables." << endl;
+          return false;
+        }
+        delta = variableAddresses[iObject][relocation.name] - assembled->second;
+      }
+      else if (relocation.kind == RELOC_EXTERN) {
+        if (globals.find(relocation.name) == globals.end()) {
+          cout << "[error] \"" << object.fileName << "\" uses \"" << relocation.name << "\", which no file exports." << endl;
+          return false;
+        }
+        delta = globals[relocation.name].first;
+      }
+      InitRAMContent[base + relocation.offset] = (InitRAMContent[base + relocation.offset] + delta) & 0xff;
+    }
+
+    for (unsigned int i = 0; i < object.instructionAddresses.size(); ++i)
+      info.instructionAddresses.push_back(base + object.instructionAddresses[i]);
+    for (auto bound = object.loopBounds.begin(); bound != object.loopBounds.end(); ++bound)
+      info.loopBounds[base + bound->first] = bound->second;
+
+    string fileStem = object.fileName.substr(object.fileName.find_last_of("/\\") + 1);
+    fileStem = fileStem.substr(0, fileStem.rfind('.'));
+    auto getMapName = [&](const string& name) {
+      bool isGlobal = find(object.globals.begin(), object.globals.end(), name) != object.globals.end();
+      return (isGlobal || nameCounts[name] == 1) ? name : fileStem + "." + name;
+    };
+
+    for (unsigned int iTag = 0; iTag < object.tags.size(); ++iTag) {
+      int address = base + object.tags[iTag].second;
+      if (info.tagNames.find(address) == info.tagNames.end())
+        info.tagNames[address] = object.tags[iTag].first;
+      info.tags.push_back(make_pair(getMapName(object.tags[iTag].first), address));
+    }
+    for (unsigned int iName = 0; iName < object.variables.size(); ++iName) {
+      const string& name = object.variables[iName].first;
+      info.variables.push_back(make_pair(getMapName(name), variableAddresses[iObject][name]));
+      if (object.initializers.find(name) != object.initializers.end())
+        info.initializers[getMapName(name)] = base + object.initializers.at(name);
+    }
+  }
+  info.codeSize = codeEnd;
+
+  // Where everything went
+  for (unsigned int iObject = 0; iObject < objects.size(); ++iObject) {
+    const ObjectFile& object = objects[iObject];
+    cout << "    [+] " << object.fileName << ": code at " << codeBases[iObject];
+    if (!object.code.empty())
+      cout << " to " << codeBases[iObject] + object.code.size() - 1;
+    cout << ", " << object.variables.size() << " variables" << endl;
+  }
+  if (!globals.empty())
+    cout << "[debug] Exported names..." << endl;
+  for (auto global = globals.begin(); global != globals.end(); ++global)
+    cout << "    [+] " << global->first << ": " << toBinaryString(global->second.first, 8) << " (" << global->second.first << ")" << endl;
+
+  bool isExtended = false;
+  for (unsigned int iObject = 0; iObject < objects.size(); ++iObject)
+    isExtended |= objects[iObject].isExtended;
+  if (isExtended)
+    cout << "[debug] Some files use the extended ISA, run the program with \"--extended\"." << endl;
+  return true;
+}
+
+// The object of a source, assembled again only when it is
+// missing, older than the source or made for the other ISA.
+bool buildObject(string sourceName, ObjectFile& object) {
+  string     objectName = getOutputName(sourceName, ".obj");
+  error_code error;
+  filesystem::file_time_type sourceTime = filesystem::last_write_time(sourceName, error);
+  if (error) {
+    cout << "[error] No such file \"" << sourceName << "\" is found." << endl;
+    return false;
+  }
+
+  filesystem::file_time_type objectTime = filesystem::last_write_time(objectName, error);
+  if (!error && objectTime >= sourceTime) {
+    cout.setstate(ios::failbit);    // a broken object is only made again
+    bool isRead = readObjectFile(objectName, object);
+    cout.clear();
+    if (isRead && object.isExtended == ExtendedISA) {
+      cout << "[debug] \"" << objectName << "\" is up to date." << endl;
+      return true;
+    }
+  }
+
+  vector<int> InitRAMContent;
+  ProgramInfo info;
+  object          = ObjectFile();
+  object.fileName = objectName;
+  info.object     = &object;
+  return compileCodeFile(sourceName, InitRAMContent, info) && writeObjectFile(object, objectName);
+}
+
+// "<name>.obj" files are taken as they are, sources are assembled when needed.
+bool linkFiles(string outputName, const vector<string>& inputNames, bool isAnalyzing) {
+  vector<ObjectFile> objects(inputNames.size());
+  for (unsigned int i = 0; i < inputNames.size(); ++i) {
+    string inputName = inputNames[i];
+    bool   isObject  = inputName.length() > 4 && inputName.substr(inputName.length() - 4) == ".obj";
+    if (!(isObject ? readObjectFile(inputName, objects[i]) : buildObject(inputName, objects[i])))
+      return false;
+  }
+
+  vector<int> InitRAMContent;
+  ProgramInfo info;
+  if (!linkObjects(objects, InitRAMContent, info) || !writeInitRAMToFile(InitRAMContent, outputName)
+      || !writeSymbolFile(info, getOutputName(outputName, ".sym")))
+    return false;
+
+  if (isAnalyzing)
+    analyzeProgram(InitRAMContent, info);
+  return true;
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////
+//                                   GENERATOR FUNCTIONS
+//////////////////////////////////////////////////////////////////////////////////////////////
+
+/* Shape of the programs of --generate */
+struct GeneratorOptions {
+  int       size      = 128;       // bytes of code, about
+  int       branches  = 25;        // % of the blocks skipped by a JC or JZ
+  int       stores    = 10;        // % of the blocks patching an operand of the code
+  int       depth     = 2;         // loops nested at most
+  long long maxCycles = 100000;    // every path reaches HLT within
+  int       count     = 1;         // programs written
+  int       seed      = 1;         // of the first one, then seed + 1...
+};
+
+const int GENERATED_VARIABLES = 6;   // v0 to v5, then c1, c2... for the loops
+
+/* Part of a generated program, with its size &
+   worst case (every jump taken, every block run) */
+struct GeneratedCode {
+  string    text;
+  int       bytes  = 0;
+  long long cycles = 0;
+};
+
+void emitInstruction(GeneratedCode& code, int opcode, string operand = "") {
+  code.text   += "  " + string(getMnemonic(opcode)) + (operand != "" ? " " + operand : "") + "\n";
+  code.bytes  += hasOperand(opcode) ? 2 : 1;
+  code.cycles += getInstructionCycles(opcode, true);
+}
+
+void emitCode(GeneratedCode& code, const GeneratedCode& part) {
+  code.text   += part.text;
+  code.bytes  += part.bytes;
+  code.cycles  = addCycles(code.cycles, part.cycles);
+}
+
+string getGeneratedVariable(mt19937& random) {
+  return "v" + to_string(random() % GENERATED_VARIABLES);
+}
+
+// A variable computed from others, or one shown by OUT
+// (only outside of the loops, so outputs stay few).
+void generateStatement(GeneratedCode& code, int level, mt19937& random) {
+  switch (random() % (level == 0 ? 7 : 6)) {
+    case 0:
+      emitInstruction(code, LDA, getGeneratedVariable(random));
+      emitInstruction(code, ADD, getGeneratedVariable(random));
+      break;
+    case 1:
+      emitInstruction(code, LDA, getGeneratedVariable(random));
+      emitInstruction(code, SUB, getGeneratedVariable(random));
+      break;
+    case 2:
+      emitInstruction(code, LDI, to_string(random() % 256));
+      break;
+    case 3:
+      emitInstruction(code, LDA, getGeneratedVariable(random));
+      emitInstruction(code, SLF);
+      break;
+    case 4:
+      emitInstruction(code, SHL, getGeneratedVariable(random));
+      break;
+    case 5:
+      emitInstruction(code, LDA, getGeneratedVariable(random));
+      emitInstruction(code, random() % 2 ? AEI : SEI, to_string(1 + random() % 15));
+      break;
+    default:
+      emitInstruction(code, LDA, getGeneratedVariable(random));
+      emitInstruction(code, _OUT);
+      return;
+  }
+  emitInstruction(code, STA, getGeneratedVariable(random));
+}
+
+/* Blocks until the code is <bytes> long, at loop depth <level>:
+   statements, statements skipped by a forward JC or JZ, stores
+   into the operand of a later LDI or ADD, and loops counting
+   c<level + 1> down from at most <maxBound>. Jumps only go
+   forward but for the loops, and only LDI & ADD operands are
+   patched, so every path reaches the end. */
+void generateBlocks(GeneratedCode& code, int bytes, int level, int maxBound, const GeneratorOptions& options,
+                    mt19937& random, int& label) {
+  while (code.bytes < bytes) {
+    GeneratedCode block;
+    int           kind = random() % 100;
+    string        name = to_string(label++);
+
+    if (level < options.depth && random() % 4 == 0 && bytes - code.bytes >= 24) {
+      int    bound   = 1 + random() % maxBound;
+      string counter = "c" + to_string(level + 1);
+      GeneratedCode body;
+      generateBlocks(body, min(bytes - code.bytes - 14, 8 + (int)(random() % 32)), level + 1, maxBound, options, random, label);
+
+      emitInstruction(block, LDI, to_string(bound));
+      emitInstruction(block, STA, counter);
+      block.text += "loop_" + name + ":    # @bound " + to_string(bound) + "\n";
+      emitCode(block, body);
+      emitInstruction(block, LDA, counter);
+      emitInstruction(block, SEI, "1");
+      emitInstruction(block, STA, counter);
+      emitInstruction(block, JZ, "end_" + name);
+      emitInstruction(block, JMP, "loop_" + name);
+      block.text += "end_" + name + ":\n";
+
+      // Only the LDI & STA before the loop run once
+      long long once = getInstructionCycles(LDI, true) + getInstructionCycles(STA, true);
+      block.cycles = addCycles(multiplyCycles(block.cycles - once, bound), once);
+    }
+    else if (kind < options.branches) {
+      emitInstruction(block, LDA, getGeneratedVariable(random));
+      emitInstruction(block, random() % 2 ? SUB : ADD, getGeneratedVariable(random));
+      emitInstruction(block, random() % 2 ? JC : JZ, "skip_" + name);
+      for (int i = 1 + random() % 3; i > 0; --i)
+        generateStatement(block, level, random);
+      block.text += "skip_" + name + ":\n";
+    }
+    else if (kind < options.branches + options.stores) {
+      emitInstruction(block, LDA, getGeneratedVariable(random));
+      emitInstruction(block, STA, "patch_" + name + " + 1");
+      bool isAddress = random() % 2;
+      if (isAddress)
+        emitInstruction(block, LDA, getGeneratedVariable(random));
+      block.text += "patch_" + name + ":\n";
+      emitInstruction(block, isAddress ? ADD : LDI, "0");
+      emitInstruction(block, STA, getGeneratedVariable(random));
+    }
+    else
+      generateStatement(block, level, random);
+
+    emitCode(code, block);
+  }
+}
+
+// Loop bounds are halved until the worst case fits the cycles.
+bool generateProgram(const GeneratorOptions& options, int seed, GeneratedCode& program) {
+  for (int maxBound = 16; maxBound >= 1; maxBound /= 2) {
+    mt19937 random(seed);
+    int     label = 0;
+
+    program = GeneratedCode();
+    for (int i = 0; i < GENERATED_VARIABLES; ++i) {
+      emitInstruction(program, LDI, to_string(random() % 256));
+      emitInstruction(program, STA, "v" + to_string(i));
+    }
+    program.text += "start:\n";
+    generateBlocks(program, options.size - 4, 0, maxBound, options, random, label);
+    emitInstruction(program, LDA, "v0");
+    emitInstruction(program, _OUT);
+    emitInstruction(program, HLT);
+
+    if (program.cycles < options.maxCycles) {
+      program.text = "# Generated by --generate, seed " + to_string(seed) + ": " + to_string(program.bytes)
+                   + " bytes, at most " + to_string(program.cycles) + " cycles.\n" + program.text;
+      return true;
+    }
+  }
+
+  cout << "[error] Programs of " << options.size << " bytes need more than " << options.maxCycles << " cycles." << endl;
+  return false;
+}
+
+// "size=160" & the like, into <options>
+bool parseGeneratorOption(string option, GeneratorOptions& options) {
+  size_t    equal    = option.find('=');
+  string    key      = option.substr(0, equal);
+  string    value    = (equal == string::npos) ? "" : option.substr(equal + 1);
+  long long number   = toInteger(value);
+  bool      isNumber = (value != "" && isInt(value));
+
+  if (!isNumber)
+    value = "";
+  else if (key == "size" && number >= 32 && number <= 200)
+    options.size = number;
+  else if (key == "branches" && number <= 100)
+    options.branches = number;
+  else if (key == "stores" && number <= 100)
+    options.stores = number;
+  else if (key == "depth" && number <= 4)
+    options.depth = number;
+  else if (key == "cycles" && number >= 1000)
+    options.maxCycles = number;
+  else if (key == "count" && number >= 1)
+    options.count = number;
+  else if (key == "seed")
+    options.seed = number;
+  else
+    value = "";
+
+  if (value == "" || options.branches + options.stores > 100) {
+    cout << "[error] Wrong generator option \"" << option << "\", see the usage." << endl;
+    return false;
+  }
+  return true;
+}
+
+/* Writes <count> programs ("Name.su", or "Name-1.su"...) &
+   a manifest of them for "run --jobs" ("Name.jobs"), with
+   the outputs each one gives & the ISA it is written for.
+   Every program is assembled & run here first, to be sure
+   it halts in time. */
+bool generateFiles(string outputName, const GeneratorOptions& options) {
+  string baseName     = outputName.substr(0, outputName.rfind('.'));
+  string manifestName = baseName + ".jobs";
+  string manifest     = "# " + to_string(options.count) + " programs of --generate, "
+                      + to_string(options.maxCycles) + " cycles at most each\n";
+  long long totalCycles = 0;
+
+  for (int i = 0; i < options.count; ++i) {
+    GeneratedCode program;
+    if (!generateProgram(options, options.seed + i, program))
+      return false;
+
+    vector<int> InitRAMContent;
+    ProgramInfo info;
+    cout.setstate(ios::failbit);
+    bool isCompiled = compileCode(program.text, InitRAMContent, info);
+    cout.clear();
+    if (!isCompiled) {
+      cout << "[error] Generated program " << options.seed + i << " does not assemble." << endl;
+      return false;
+    }
+
+    uint8_t image[256];
+    for (int j = 0; j < 256; ++j)
+      image[j] = InitRAMContent[j];
+    ConstMachine machine = runConstMachine(image, sizeof(image), options.maxCycles, ExtendedISA);
+    if (machine.stop != CONST_STOP_HLT || machine.outputCount > CONST_OUTPUTS) {
+      cout << "[error] Generated program " << options.seed + i << " does not halt in time." << endl;
+      return false;
+    }
+    totalCycles += machine.cycleCounting;
+
+    string fileName = (options.count == 1) ? baseName + ".su" : baseName + "-" + to_string(i + 1) + ".su";
+    fstream sourceFile(fileName, fstream::out);
+    sourceFile << program.text;
+    sourceFile.close();
+    if (!sourceFile) {
+      cout << "[error] Cannot write \"" << fileName << "\"." << endl;
+      return false;
+    }
+
+    manifest += filesystem::path(fileName).filename().string() + " max-cycles=" + to_string(options.maxCycles)
+              + (ExtendedISA ? " isa=extended" : "") + " expect=";
+    for (int j = 0; j < machine.outputCount; ++j)
+      manifest += (j > 0 ? "," : "") + to_string(machine.outputs[j]);
+    manifest += "\n";
+  }
+
+  fstream manifestFile(manifestName, fstream::out);
+  manifestFile << manifest;
+  manifestFile.close();
+  if (!manifestFile) {
+    cout << "[error] Cannot write \"" << manifestName << "\"." << endl;
+    return false;
+  }
+
+  cout << "[generate] " << options.count << " programs & \"" << manifestName << "\" written, "
+       << totalCycles << " cycles to run them all." << endl;
+  return true;
 }
 
 //////////////////////////////////////////////////////////////////////////////////////////////
 //                                        MAIN
 //////////////////////////////////////////////////////////////////////////////////////////////
 
+#ifdef FUZZ
+/* libFuzzer entry, replacing main():
+     clang++ -g -O1 -DFUZZ -fsanitize=fuzzer,address,undefined parser.cpp -o parser-fuzz
+   Every input is a source file. Besides crashes, it stops on a
+   program that compiles into something the machine cannot load. */
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size) {
+  static bool isInitialized = false;
+  if (!isInitialized) {
+    initGlobal();
+    cout.setstate(ios::failbit);    // no logs, they are most of the time
+    isInitialized = true;
+  }
+
+  vector<int> InitRAMContent;
+  ProgramInfo info;
+  if (!compileCode(string_view((const char*)data, size), InitRAMContent, info))
+    return 0;
+
+  if (InitRAMContent.size() != 256 || info.codeSize > 256)
+    abort();
+  for (unsigned int i = 0; i < InitRAMContent.size(); ++i) {
+    if (InitRAMContent[i] < 0 || InitRAMContent[i] > 255)
+      abort();
+  }
+
+  analyzeProgram(InitRAMContent, info);
+  return 0;
+}
+#else
+/* A program of about "size" bytes for --bench: a few real
+   instructions with address arithmetic & a macro, drowned
+   in tags, comments & blank lines. */
+string generateBenchmarkSource(size_t size) {
+  string source = ".macro add_to dst, src\n"
+                  "    lda \\dst\n"
+                  "    add \\src\n"
+                  "    sta \\dst\n"
+                  ".endm\n"
+                  "\n"
+                  "start:\n"
+                  "    ldi 0\n"
+                  "    sta total\n";
+  int codeSize = 4;
+
+  for (int iBlock = 0; source.size() < size; ++iBlock) {
+    source += "block_" + to_string(iBlock) + ":    # @bound 4\n";
+    source += "    # Adds the next entry of the table to the total, the usual kind of comment.\n";
+    if (iBlock % 64 == 0 && codeSize + 6 <= 200) {
+      source += "    add_to total, table + " + to_string(iBlock % 16) + "\n";
+      codeSize += 6;
+    }
+    source += "\n";
+  }
+
+  source += "    lda total\n    out\n    hlt\n\ntable:\n";
+  for (int i = 0; i < 16; ++i)
+    source += to_string(i) + "\n";
+  return source;
+}
+
+// Assembles the generated source from memory for a second
+// at least, without the logs, and prints the throughput.
+void runBenchmark(int megabytes) {
+  string source     = generateBenchmarkSource((size_t)megabytes * 1000000);
+  int    runs       = 0;
+  double seconds    = 0;
+  bool   isCompiled = true;
+
+  cout.setstate(ios::failbit);
+  auto start = chrono::steady_clock::now();
+  while (isCompiled && (runs < 3 || seconds < 1.0)) {
+    vector<int> InitRAMContent;
+    ProgramInfo info;
+    isCompiled = compileCode(source, InitRAMContent, info);
+    runs++;
+    seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+  }
+  cout.clear();
+
+  if (!isCompiled) {
+    cout << "[error] The generated program does not compile." << endl;
+    return;
+  }
+  cout << "[bench] " << source.size() / 1e6 << " MB of source assembled " << runs << " times in " << seconds << " s: "
+       << source.size() * runs / 1e6 / seconds << " MB/s" << endl;
+}
+
 int main(int argc, char *argv[]) {
   initGlobal();
 
   if (argc <= 1) {
-    cout << "[usage] " << argv[0] << " <Source.su>" << endl;
+    cout << "[usage] " << argv[0] << " [--cfg] [--extended] [--object] <Source.su> ..." << endl;
+    cout << "        " << argv[0] << " [--cfg] [--extended] --link <Program.out> <Source.su|Object.obj> ..." << endl;
+    cout << "    --cfg         Print basic blocks, loops and worst-case cycles of the following files." << endl;
+    cout << "    --extended    Use short forms (argument 1 to 15 in the opcode) for the following files." << endl;
+    cout << "    --object      Assemble the following files into relocatable objects (\".obj\")." << endl;
+    cout << "    --link <out>  Link the remaining files into <out>, assembling the sources changed since their object." << endl;
+    cout << "    --bench <MB>  Time assembling a generated source of <MB> megabytes." << endl;
+    cout << "    --generate <Name.su> [size=128] [branches=25] [stores=10] [depth=2] [cycles=100000] [count=1] [seed=1]" << endl;
+    cout << "                  Write random programs that halt within <cycles>, & a \"--jobs\" manifest of them." << endl;
     cout << "[error] No arguments are given to the program!" << endl;
     return 0;
   }
 
+  bool isAnalyzing = false;
+  bool isObject    = false;
+  bool hasFailed   = false;
   for (int i = 1; i < argc; ++i) {
+    if (string(argv[i]) == "--cfg") {
+      isAnalyzing = true;
+      continue;
+    }
+
+    if (string(argv[i]) == "--object") {
+      isObject = true;
+      continue;
+    }
+
+    // Takes all the files left
+    if (string(argv[i]) == "--link") {
+      if (i + 2 >= argc) {
+        cout << "[error] \"--link\" needs an output file and the files to link." << endl;
+        return 1;
+      }
+      if (!linkFiles(argv[i + 1], vector<string>(argv + i + 2, argv + argc), isAnalyzing))
+        hasFailed = true;
+      break;
+    }
+
+    if (string(argv[i]) == "--extended") {
+      ExtendedISA = true;
+      continue;
+    }
+
+    // Takes the "key=value" options after the name
+    if (string(argv[i]) == "--generate") {
+      GeneratorOptions options;
+      if (i + 1 >= argc) {
+        cout << "[error] \"--generate\" needs the name of the programs." << endl;
+        return 1;
+      }
+      string outputName = argv[++i];
+      while (i + 1 < argc && string(argv[i + 1]).find('=') != string::npos && string(argv[i + 1]).substr(0, 2) != "--") {
+        if (!parseGeneratorOption(argv[++i], options))
+          return 1;
+      }
+      if (!generateFiles(outputName, options))
+        hasFailed = true;
+      continue;
+    }
+
+    if (string(argv[i]) == "--bench") {
+      int megabytes = (i + 1 < argc && isInt(argv[i + 1])) ? toInteger(argv[++i]) : 0;
+      if (megabytes <= 0) {
+        cout << "[error] \"--bench\" needs a size in megabytes." << endl;
+        return 0;
+      }
+      runBenchmark(megabytes);
+      continue;
+    }
+
     vector<int> InitRAMContent;
+    ProgramInfo info;
     string assemblyCodeFileName_In;
     string machineCodeFileName_Out;
 
     assemblyCodeFileName_In = string(argv[i]);
     machineCodeFileName_Out = getOutputName(assemblyCodeFileName_In);
 
-    if (compileCodeFile(assemblyCodeFileName_In, InitRAMContent))
-      writeInitRAMToFile(InitRAMContent, machineCodeFileName_Out);
+    if (isObject) {
+      ObjectFile object;
+      object.fileName = getOutputName(assemblyCodeFileName_In, ".obj");
+      info.object     = &object;
+      if (!compileCodeFile(assemblyCodeFileName_In, InitRAMContent, info) || !writeObjectFile(object, object.fileName))
+        hasFailed = true;
+      continue;
+    }
+
+    if (compileCodeFile(assemblyCodeFileName_In, InitRAMContent, info)
+        && writeInitRAMToFile(InitRAMContent, machineCodeFileName_Out)
+        && writeSymbolFile(info, getOutputName(assemblyCodeFileName_In, ".sym"))) {
+      if (isAnalyzing)
+        analyzeProgram(InitRAMContent, info);
+    }
+    else
+      hasFailed = true;
   }
+  return hasFailed ? 1 : 0;
 }
+#endif
@@ -4,50 +4,151 @@
 #include <vector>
 #include <stack>
 #include <map>
+#include <cstring>
+#include <cstdlib>
+#include <cctype>
+#include <cerrno>
+#include <csignal>
+#include <climits>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <functional>
+#include <random>
+#include <iomanip>
+#include <algorithm>
 
 #if defined(WIN32) && !defined(__unix__)
   #include <windows.h>
   #include <conio.h>
 #elif defined(__unix__) && !defined(WIN32)
-  #include <ncurses.h>
+  #ifndef LIBRARY
+    #include <ncurses.h>
+  #endif
   #include <unistd.h>
   #include <signal.h>
+  #include <fcntl.h>
+  #include <poll.h>
+  #include <sys/stat.h>
+  #include <sys/socket.h>
+  #include <sys/un.h>
+  #include <sys/wait.h>
+  #include <sys/mman.h>
 #else
 
 #endif
 
 using namespace std;
 
-#define CLK_SPEED 100 // Limited to 100 HZ
-
-#define NOP  0b00000000
-#define LDA  0b00010000
-#define ADD  0b00100000
-#define SUB  0b00110000
-#define STA  0b01000000
-#define LDI  0b01010000
-#define JMP  0b01100000
-#define JC   0b01110000
-#define JZ   0b10000000
-#define AEI  0b10010000
-#define SEI  0b10100000
-#define SHL  0b10110000
-#define SLF  0b11010000
-#define _OUT 0b11100000
-#define HLT  0b11110000
+#define CLK_SPEED  100 // Limited to 100 HZ
+#define SCREEN_FPS 30  // Redraws per second at most
+
+// Bump whenever the machine behaves differently,
+// so cached results of older runs are not reused.
+#define ENGINE_VERSION "run.cpp/1"
+
+#include "isa.h"                 // opcodes, mnemonics & cycles
+#include "machine_constexpr.h"   // performArithmetic()
+
+////////////////////// Compile-time checks /////////////////////////////////
+// Small programs run by the constexpr machine while compiling, so a
+// change to what an instruction does or costs breaks the build.
+// The fuzzer checks that run() agrees with the constexpr machine.
+
+constexpr uint8_t CheckLoadOut[]  = { LDI, 7, _OUT, HLT };
+constexpr uint8_t CheckStore[]    = { LDI, 42, STA, 15, HLT };
+constexpr uint8_t CheckCarry[]    = { LDI, 200, ADD, 6, _OUT, HLT, 100 };
+constexpr uint8_t CheckZero[]     = { LDI, 5, SEI, 5, JZ, 7, HLT, LDI, 1, HLT };
+constexpr uint8_t CheckShift[]    = { LDI, 1, SLF, _OUT, JC, 8, JMP, 2, HLT };
+constexpr uint8_t CheckUnknown[]  = { 0b11000000 };
+constexpr uint8_t CheckBudget[]   = { JMP, 0 };
+constexpr uint8_t CheckShort[]    = { LDI | 7, AEI | 3, SEI | 10, JZ | 6, HLT, HLT, _OUT, HLT };
+constexpr uint8_t CheckMultiply[] = {   // example-su-asms/MultiplySlow.su, 15 * 15
+  0x50, 0x0f, 0x40, 0xff, 0x50, 0x0f, 0x40, 0xfe, 0x50, 0x00, 0x40, 0xfd, 0x10, 0xfe, 0xa0, 0x01,
+  0x70, 0x1c, 0x40, 0xfe, 0x10, 0xfd, 0x20, 0xff, 0x40, 0xfd, 0x60, 0x0c, 0x10, 0xfd, 0xe0, 0xf0 };
+
+static_assert(runConstMachine(CheckLoadOut).outputs[0] == 7, "LDI or OUT");
+static_assert(runConstMachine(CheckLoadOut).cycleCounting == 9, "cycles of LDI, OUT or HLT");
+static_assert(runConstMachine(CheckStore).RAMContent[15] == 42, "STA");
+static_assert(runConstMachine(CheckCarry).outputs[0] == 44 && runConstMachine(CheckCarry).CarryFlag == 1, "ADD carry");
+static_assert(runConstMachine(CheckCarry).cycleCounting == 15, "cycles of ADD");
+static_assert(runConstMachine(CheckZero).ARegister == 1 && runConstMachine(CheckZero).CarryFlag == 0, "SEI or JZ");
+static_assert(runConstMachine(CheckShift).outputCount == 8 && runConstMachine(CheckShift).outputs[6] == 128, "SLF or JC");
+static_assert(runConstMachine(CheckShift).cycleCounting == 115, "cycles of SLF, JC or JMP");
+static_assert(runConstMachine(CheckUnknown).stop == CONST_STOP_UNKNOWN, "unknown opcodes");
+static_assert(runConstMachine(CheckBudget, 100).stop == CONST_STOP_BUDGET, "cycle budget");
+static_assert(runConstMachine(CheckShort, 100, true).outputCount == 1 && runConstMachine(CheckShort, 100, true).outputs[0] == 0, "short forms");
+static_assert(runConstMachine(CheckShort, 100, true).cycleCounting == 19, "cycles of short forms");
+static_assert(runConstMachine(CheckShort).stop == CONST_STOP_UNKNOWN, "short forms outside the extended ISA");
+static_assert(runConstMachine(CheckMultiply).outputs[0] == 225, "MultiplySlow");
+static_assert(runConstMachine(CheckMultiply).cycleCounting == 621, "cycles of MultiplySlow");
+
+// Each byte costs what the micro-steps in isa.h say, in both ISAs,
+// conditional jumps taken (flags set) or not.
+constexpr bool checkInstructionCycles() {
+  for (int opcode = 0; opcode < 256; ++opcode)
+    for (int extended = 0; extended <= 1; ++extended)
+      for (int flags = 0; flags <= 1; ++flags) {
+        ConstMachine m;
+        m.RAMContent[0] = opcode;
+        m.RAMContent[1] = 2;
+        m.CarryFlag = m.ZeroFlag = flags;
+        m.extended  = extended;
+        stepConstMachine(m);
+        if (m.cycleCounting != getInstructionCycles(opcode, flags == 1, extended))
+          return false;
+      }
+  return true;
+}
+
+static_assert(checkInstructionCycles(), "cycles of an instruction differ from its micro-steps");
 
 //////////////////////// For Program ///////////////////////////////////
-uint8_t MemRegister;
-uint8_t ARegister;
-uint8_t BRegister;
-uint8_t SumRegister;
-uint8_t Instruction;
-uint8_t ProgramCounter;
-uint8_t OutRegister;
-uint8_t ZeroFlag;
-uint8_t CarryFlag;
-string  Argument;        /* for debugging only, not in actual machine */
-static volatile int ProgramRun = 1;
+/* All that a machine changes as it runs. The functions running it
+   take the one they move, so the library keeps one per machine.
+   The simulator runs MainMachine, the names below stand for it. */
+struct MachineCore {
+  uint8_t MemRegister    = 0;
+  uint8_t ARegister      = 0;
+  uint8_t BRegister      = 0;
+  uint8_t SumRegister    = 0;
+  uint8_t Instruction    = 0;
+  uint8_t ProgramCounter = 0;
+  uint8_t OutRegister    = 0;
+  uint8_t ZeroFlag       = 0;
+  uint8_t CarryFlag      = 0;
+  int     Argument       = -1;   /* for debugging only, not in actual machine, -1 for none */
+  int     ProgramRun     = 1;
+
+  uint8_t RAMContent[256] = {};  // To simulate memory of 256 bytes of codes
+  int     cycleCounting  = 0;
+  int     MicroStep      = 0;    // of the instruction run so far, 0 between instructions
+  uint8_t NextMove       = 0;    // what the instruction does after it, a MOVE_* of the main loop
+
+  // Bytes written since the last reset,
+  // so a reset only copies those back.
+  uint64_t DirtyRAMMap[4]     = {};
+  uint8_t  DirtyRAMList[256]  = {};
+  int      DirtyRAMCount      = 0;
+
+  vector<uint8_t> OutHistory;    // Every value OUT has shown
+  string          StopReason;    // "hlt", "unknown" opcode or cycle "budget"
+};
+
+MachineCore MainMachine;
+uint8_t &MemRegister    = MainMachine.MemRegister;
+uint8_t &ARegister      = MainMachine.ARegister;
+uint8_t &BRegister      = MainMachine.BRegister;
+uint8_t &SumRegister    = MainMachine.SumRegister;
+uint8_t &Instruction    = MainMachine.Instruction;
+uint8_t &ProgramCounter = MainMachine.ProgramCounter;
+uint8_t &OutRegister    = MainMachine.OutRegister;
+uint8_t &ZeroFlag       = MainMachine.ZeroFlag;
+uint8_t &CarryFlag      = MainMachine.CarryFlag;
+int     &Argument       = MainMachine.Argument;
+int     &ProgramRun     = MainMachine.ProgramRun;
 
 ////////////////////// Output modes //////////////////////////////////////
 const uint8_t SIGNED   = 0;
@@ -57,17 +158,629 @@ const uint8_t AUTO     = 1;
 const uint8_t ENTER    = 10;
 const uint8_t SPACE    = 32;
 
+uint8_t OutputMode = SIGNED;    // screen thread only
+uint8_t DebugMode  = MANUAL;    // machine thread only
+
 ////////////////////// Program infos ///////////////////////////////////////
 
-uint8_t RAMContent[256];     // To simulate memory of 256 bytes of codes
-int cycleCounting = 0;
+uint8_t (&RAMContent)[256] = MainMachine.RAMContent;
+uint8_t InitialRAMContent[256];   // As loaded, for resets
+int     &cycleCounting     = MainMachine.cycleCounting;
+int     &MicroStep         = MainMachine.MicroStep;
+uint8_t &NextMove          = MainMachine.NextMove;
+
+uint64_t (&DirtyRAMMap)[4]    = MainMachine.DirtyRAMMap;
+uint8_t  (&DirtyRAMList)[256] = MainMachine.DirtyRAMList;
+int      &DirtyRAMCount       = MainMachine.DirtyRAMCount;
+
+vector<uint8_t> &OutHistory  = MainMachine.OutHistory;
+string          &StopReason  = MainMachine.StopReason;
+bool            ExtendedISA = false;   // Short forms of isa.h
+
+////////////////////// Batch mode //////////////////////////////////////////
+// Runs without the screen until HLT or the cycle budget,
+// then prints the final state.
+#ifdef LIBRARY
+bool   BatchMode   = true;      // Library machines only stop when
+int    CycleBudget = INT_MAX;   // their cycle counter is full
+#else
+bool   BatchMode   = false;
+int    CycleBudget = 10000000;
+#endif
+string CacheDir    = "";        // Where results of earlier runs are kept
+
+////////////////////// Symbol overrides ////////////////////////////////////
+// Values written to memory before the run, by name from the symbol
+// map the parser writes next to the image, so one image runs on
+// other data without being assembled again.
+struct ProgramSymbol {
+  int  address;
+  int  initializer;       // operand of the "LDI n" giving a variable its first value, -1 if none
+  bool isVariable;        // or a tag
+};
+
+struct Override {
+  string  name;           // or an address
+  int     offset;         // "<name>+<offset>"
+  uint8_t value;
+};
+
+vector<Override> Overrides;              // --set & --set-file
+string           SymbolFileName = "";    // "" for the image with ".sym"
+
+////////////////////// Debug server ////////////////////////////////////////
+// Runs without the screen, driven by a client over a local socket.
+bool   ServerMode = false;
+string SocketPath = "";
+
+////////////////////// Divergence search ///////////////////////////////////
+// Runs a second image side by side, looking for the first difference.
+string DiffFileName = "";
+
+////////////////////// Job runner //////////////////////////////////////////
+// Runs every job of a manifest in worker processes, then writes a report.
+string JobsFileName   = "";
+string ReportFileName = "";           // JSON, or CSV when it ends with ".csv"
+string ParserPath     = "./parser";   // Assembles the ".su" jobs
+int    JobWorkers     = 0;            // 0: one per CPU, for faults too
+
+////////////////////// Fault injection /////////////////////////////////////
+// Flips single bits at chosen or random cycles & sorts out what
+// became of each run, against the run without faults.
+int            FaultCount   = 0;       // Random faults to inject
+string         FaultTargets = "ram,a,b,sum,ir,flags";
+uint64_t       FaultSeed    = 1;
+vector<string> ChosenFaults;           // "<cycle>:<target>:<bit>"
+
+////////////////////// Switching activity //////////////////////////////////
+// Counts the bits flipped in each register & on the bus at every
+// micro-step of a batch run, by instruction address & by opcode.
+const int   ACTIVITY_SIGNALS = 8;
+const char* ActivityNames[ACTIVITY_SIGNALS] = { "mar", "a", "b", "sum", "ir", "pc", "out", "bus" };
+
+struct ActivityCounts {
+  uint64_t runs;                          // instructions
+  uint64_t steps;                         // micro-steps
+  uint64_t toggles[ACTIVITY_SIGNALS];
+};
+
+string         ActivityFileName = "";     // JSON, or CSV when it ends with ".csv"
+bool           ActivityMode     = false;
+uint64_t       ActivityLast     = 0;      // a byte by signal, at the last micro-step
+uint8_t        ActivityAddress  = 0;      // of the instruction being run
+int            ActivityStep     = 0;      // its micro-steps so far
+uint64_t       ActivityToggles  = 0;      // its toggles, a byte by signal
+ActivityCounts ActivityByAddress[256];
+ActivityCounts ActivityByOpcode[256];
+
+////////////////////// Taint tracking //////////////////////////////////////
+// Which bytes of the loaded image the values shown by OUT come from,
+// in a batch run. Each address starts tainted by itself, then a set
+// of addresses (a bit each, as the address maps) follows every value
+// through memory, A, B & the flags.
+struct TaintSet {
+  uint64_t bits[4];
+};
+
+struct TaintedOutput {
+  TaintSet data;        // what the value was computed from
+  TaintSet control;     // what the conditional jumps before it looked at
+};
+
+string                TaintFileName = "";   // JSON, or CSV when it ends with ".csv"
+bool                  TaintMode     = false;
+TaintSet              TaintRAM[256];
+TaintSet              TaintA;
+TaintSet              TaintB;
+TaintSet              TaintFlags;
+TaintSet              TaintControl;         // of every conditional jump so far
+vector<TaintedOutput> TaintOutputs;         // by OUT, as OutHistory
+
+////////////////////// Profiling ///////////////////////////////////////////
+// Build with -DPROFILE to see where the time goes. A JSON summary
+// is written to stderr at exit. Without it the PROFILE_* macros
+// are empty and nothing is counted.
+#ifdef PROFILE
+struct ProfileTimer {
+  uint64_t calls;
+  uint64_t nanoseconds;
+};
+
+// Adds the time until the end of the scope to a timer.
+struct ProfileScope {
+  ProfileTimer                     &timer;
+  chrono::steady_clock::time_point  start;
+
+  ProfileScope(ProfileTimer &timer) : timer(timer), start(chrono::steady_clock::now()) {}
+  ~ProfileScope() {
+    timer.calls++;
+    timer.nanoseconds += chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - start).count();
+  }
+};
+
+// Each one is only touched by a single thread.
+uint64_t     ProfileOpcodes[256];   // machine: instructions by opcode
+uint64_t     ProfileMicroSteps;     // machine: cycles counted
+uint64_t     ProfileCommands;       // machine: commands from the screen
+ProfileTimer ProfilePublish;        // machine: publishing snapshots
+ProfileTimer ProfileSleep;          // machine: clock delay in AUTO mode
+ProfileTimer ProfileWait;           // machine: waiting for the user in MANUAL mode
+ProfileTimer ProfileDisplay;        // screen: displayInfo()
+ProfileTimer ProfileRefresh;        // screen: drawing to the terminal
+ProfileTimer ProfileInput;          // screen: polling the keyboard
+chrono::steady_clock::time_point ProfileStart = chrono::steady_clock::now();
+
+  #define PROFILE_COUNT(counter) (counter)++
+  #define PROFILE_SCOPE(timer)   ProfileScope profileScope(timer)
+#else
+  #define PROFILE_COUNT(counter)
+  #define PROFILE_SCOPE(timer)
+#endif
+
+////////////////////// Breakpoints & watchpoints ///////////////////////////
+// One bit per address for each kind. The machine only
+// looks at them when something is armed, so a run without
+// any breakpoint pays a single test per check.
+uint64_t BreakPCMap[4];
+uint64_t WatchReadMap[4];
+uint64_t WatchWriteMap[4];
+bool     BreakArmed  = false;    // PC breakpoints or conditions are set
+bool     WatchArmed  = false;    // RAM watchpoints are set
+string   BreakReason = "";       // Why the machine stopped last time
+
+// Operand kinds for conditional breaks
+const uint8_t OPERAND_NUMBER   = 0;
+const uint8_t OPERAND_REGISTER = 1;
+const uint8_t OPERAND_RAM      = 2;
+
+// Comparators for conditional breaks
+const uint8_t COMPARE_NONZERO  = 0;
+const uint8_t COMPARE_EQ       = 1;
+const uint8_t COMPARE_NE       = 2;
+const uint8_t COMPARE_LT       = 3;
+const uint8_t COMPARE_LE       = 4;
+const uint8_t COMPARE_GT       = 5;
+const uint8_t COMPARE_GE       = 6;
+
+struct BreakOperand {
+  uint8_t  kind;
+  int      value;       // number or RAM address
+  uint8_t* reg;         // register to read
+};
+
+struct BreakCompare {
+  BreakOperand lhs;
+  uint8_t      op;
+  BreakOperand rhs;
+};
+
+// Each condition is an OR of ANDs of comparisons,
+// a break happens when any of the conditions holds.
+vector<vector<vector<BreakCompare> > > BreakConditions;
+vector<string>                         BreakConditionTexts;
+
+////////////////////// Stepping ///////////////////////////////////////////
+// How far the machine runs before showing itself again.
+// Anything but STEP_MICRO skips the display between
+// micro-steps, only counting the cycles.
+const uint8_t STEP_MICRO        = 0;
+const uint8_t STEP_INSTRUCTIONS = 1;
+const uint8_t RUN_UNTIL_OUT     = 2;
+const uint8_t RUN_UNTIL_HLT     = 3;
+
+uint8_t StepMode         = STEP_MICRO;
+int     InstructionsLeft = 0;      // for STEP_INSTRUCTIONS
+
+inline bool testAddressBit(const uint64_t* addressMap, uint8_t address) {
+  return (addressMap[address >> 6] >> (address & 63)) & 0x1;
+}
+
+inline void setAddressBit(uint64_t* addressMap, uint8_t address) {
+  addressMap[address >> 6] |= (uint64_t)1 << (address & 63);
+}
+
+inline bool isAddressMapEmpty(uint64_t* addressMap) {
+  return !(addressMap[0] | addressMap[1] | addressMap[2] | addressMap[3]);
+}
+
+// Accepts decimal, 0x.. hex or 0b.. binary
+bool parseNumber(string numString, int &number) {
+  int base = 10;
+  if (numString.length() > 2 && numString[0] == '0' && (numString[1] == 'x' || numString[1] == 'X'))
+    base = 16;
+  else if (numString.length() > 2 && numString[0] == '0' && (numString[1] == 'b' || numString[1] == 'B'))
+    base = 2;
+
+  if (base != 10)
+    numString.erase(0, 2);
+  if (numString == "")
+    return false;
+
+  char* numEnd;
+  number = strtol(&numString[0], &numEnd, base);
+  return *numEnd == '\0';
+}
+
+bool parseAddress(string addressString, uint8_t &address) {
+  int number;
+  if (!parseNumber(addressString, number) || number < 0 || number > 255)
+    return false;
+
+  address = number;
+  return true;
+}
+
+uint8_t* getRegisterByName(string regName) {
+  for (unsigned int i = 0; i < regName.length(); ++i)
+    regName[i] = toupper(regName[i]);
+
+  if (regName == "A")   return &ARegister;
+  if (regName == "B")   return &BRegister;
+  if (regName == "SUM") return &SumRegister;
+  if (regName == "MAR") return &MemRegister;
+  if (regName == "PC")  return &ProgramCounter;
+  if (regName == "IR")  return &Instruction;
+  if (regName == "OUT") return &OutRegister;
+  if (regName == "ZF")  return &ZeroFlag;
+  if (regName == "CF")  return &CarryFlag;
+  return NULL;
+}
+
+// Split a condition into names, numbers, [, ] and comparators.
+vector<string> tokenizeCondition(string condition) {
+  vector<string> tokens;
+  unsigned int i = 0;
+  while (i < condition.length()) {
+    char c = condition[i];
+    if (isspace(c)) {
+      i++;
+    }
+    else if (isalnum(c) || c == '_') {
+      unsigned int start = i;
+      while (i < condition.length() && (isalnum(condition[i]) || condition[i] == '_'))
+        i++;
+      tokens.push_back(condition.substr(start, i - start));
+    }
+    else if (i + 1 < condition.length() && string("=!<>&|").find(c) != string::npos 
+                                         && string("=&|").find(condition[i+1]) != string::npos) {
+      tokens.push_back(condition.substr(i, 2));
+      i += 2;
+    }
+    else {
+      tokens.push_back(string(1, c));
+      i++;
+    }
+  }
+  return tokens;
+}
+
+bool parseOperand(vector<string>& tokens, unsigned int &pos, BreakOperand &operand) {
+  if (pos >= tokens.size())
+    return false;
+
+  operand.reg = NULL;
+  if (tokens[pos] == "[") {
+    uint8_t address;
+    if (pos + 2 >= tokens.size() || tokens[pos+2] != "]" || !parseAddress(tokens[pos+1], address))
+      return false;
+
+    operand.kind  = OPERAND_RAM;
+    operand.value = address;
+    pos += 3;
+    return true;
+  }
+
+  if ((operand.reg = getRegisterByName(tokens[pos])) != NULL) {
+    operand.kind = OPERAND_REGISTER;
+    pos++;
+    return true;
+  }
+
+  operand.kind = OPERAND_NUMBER;
+  return parseNumber(tokens[pos++], operand.value);
+}
+
+// condition := and-terms separated by ||
+// and-terms := comparisons separated by &&
+// comparison := operand [(== != < <= > >=) operand]
+bool parseCondition(string condition, vector<vector<BreakCompare> > &orTerms) {
+  vector<string> tokens = tokenizeCondition(condition);
+  unsigned int   pos    = 0;
+
+  orTerms.clear();
+  orTerms.push_back(vector<BreakCompare>());
+  while (true) {
+    BreakCompare compare;
+    if (!parseOperand(tokens, pos, compare.lhs))
+      return false;
+
+    compare.op = COMPARE_NONZERO;
+    if (pos < tokens.size()) {
+      string op = tokens[pos];
+      if      (op == "==") compare.op = COMPARE_EQ;
+      else if (op == "!=") compare.op = COMPARE_NE;
+      else if (op == "<" ) compare.op = COMPARE_LT;
+      else if (op == "<=") compare.op = COMPARE_LE;
+      else if (op == ">" ) compare.op = COMPARE_GT;
+      else if (op == ">=") compare.op = COMPARE_GE;
+
+      if (compare.op != COMPARE_NONZERO && !parseOperand(tokens, ++pos, compare.rhs))
+        return false;
+    }
+    orTerms.back().push_back(compare);
+
+    if (pos >= tokens.size())
+      return true;
+    if (tokens[pos] == "||")
+      orTerms.push_back(vector<BreakCompare>());
+    else if (tokens[pos] != "&&")
+      return false;
+    pos++;
+  }
+}
+
+inline int getOperandValue(const BreakOperand &operand) {
+  switch (operand.kind) {
+    case OPERAND_REGISTER:
+      return *operand.reg;
+    case OPERAND_RAM:
+      return RAMContent[operand.value];
+    default:
+      return operand.value;
+  }
+}
+
+bool evaluateCompare(const BreakCompare &compare) {
+  int lhs = getOperandValue(compare.lhs);
+  if (compare.op == COMPARE_NONZERO)
+    return lhs != 0;
+
+  int rhs = getOperandValue(compare.rhs);
+  switch (compare.op) {
+    case COMPARE_EQ: return lhs == rhs;
+    case COMPARE_NE: return lhs != rhs;
+    case COMPARE_LT: return lhs <  rhs;
+    case COMPARE_LE: return lhs <= rhs;
+    case COMPARE_GT: return lhs >  rhs;
+    case COMPARE_GE: return lhs >= rhs;
+  }
+  return false;
+}
+
+// Returns the index of the first condition that holds, -1 if none.
+int checkBreakConditions() {
+  for (unsigned int iCond = 0; iCond < BreakConditions.size(); ++iCond) {
+    for (unsigned int iOr = 0; iOr < BreakConditions[iCond].size(); ++iOr) {
+      bool holds = true;
+      for (unsigned int iAnd = 0; iAnd < BreakConditions[iCond][iOr].size() && holds; ++iAnd)
+        holds = evaluateCompare(BreakConditions[iCond][iOr][iAnd]);
+      if (holds)
+        return iCond;
+    }
+  }
+  return -1;
+}
+
+void updateBreakArmed() {
+  BreakArmed = !isAddressMapEmpty(BreakPCMap) || BreakConditions.size() > 0;
+  WatchArmed = !isAddressMapEmpty(WatchReadMap) || !isAddressMapEmpty(WatchWriteMap);
+}
+
+/*  Commands shared by the command line and the UI:
+      break  <addr>     stop before executing the instruction at <addr>
+      watch  <addr>     stop when <addr> is written
+      rwatch <addr>     stop when <addr> is read
+      awatch <addr>     stop when <addr> is read or written
+      cond   <expr>     stop before an instruction when <expr> holds
+      delete            remove every break/watch/cond above
+      step   <n>        run <n> whole instructions, then stop
+      until  out|hlt    run until the next OUT, or up to HLT          */
+bool applyDebuggerCommand(string command, string &errorMessage) {
+  stringstream ssin(command);
+  string       kind;
+  string       argument;
+  uint8_t      address;
+
+  ssin >> kind;
+  getline(ssin, argument);
+  argument.erase(0, argument.find_first_not_of(" \t"));
+
+  if (kind == "delete") {
+    memset(BreakPCMap,    0, sizeof(BreakPCMap));
+    memset(WatchReadMap,  0, sizeof(WatchReadMap));
+    memset(WatchWriteMap, 0, sizeof(WatchWriteMap));
+    BreakConditions.clear();
+    BreakConditionTexts.clear();
+  }
+  else if (kind == "cond") {
+    vector<vector<BreakCompare> > orTerms;
+    if (!parseCondition(argument, orTerms)) {
+      errorMessage = "Cannot understand condition \"" + argument + "\".";
+      return false;
+    }
+    BreakConditions.push_back(orTerms);
+    BreakConditionTexts.push_back(argument);
+  }
+  else if (kind == "break" || kind == "watch" || kind == "rwatch" || kind == "awatch") {
+    if (!parseAddress(argument, address)) {
+      errorMessage = "Address \"" + argument + "\" should be a number from 0 to 255.";
+      return false;
+    }
+
+    if (kind == "break")
+      setAddressBit(BreakPCMap, address);
+    if (kind == "rwatch" || kind == "awatch")
+      setAddressBit(WatchReadMap, address);
+    if (kind == "watch" || kind == "awatch")
+      setAddressBit(WatchWriteMap, address);
+  }
+  else if (kind == "step") {
+    if (!parseNumber(argument, InstructionsLeft) || InstructionsLeft <= 0) {
+      errorMessage = "Number of instructions \"" + argument + "\" should be a positive number.";
+      return false;
+    }
+    StepMode = STEP_INSTRUCTIONS;
+  }
+  else if (kind == "until") {
+    if (argument == "out" || argument == "OUT")
+      StepMode = RUN_UNTIL_OUT;
+    else if (argument == "hlt" || argument == "HLT")
+      StepMode = RUN_UNTIL_HLT;
+    else {
+      errorMessage = "Can only run until \"out\" or \"hlt\".";
+      return false;
+    }
+  }
+  else {
+    errorMessage = "Unknown command \"" + kind + "\" (use break, watch, rwatch, awatch, cond, delete, step or until).";
+    return false;
+  }
+
+  updateBreakArmed();
+  return true;
+}
+
+////////////////////// Snapshots ///////////////////////////////////////////
+// The machine runs on its own thread and publishes a copy of
+// itself after every micro-step it shows. The screen thread
+// draws the latest copy at its own pace. Copies go through a
+// seqlock: the sequence is odd while a copy is being written,
+// and a reader retries until the sequence is even and the same
+// before and after its read, so it never draws a torn state.
+struct MachineSnapshot {
+  uint8_t MemRegister;
+  uint8_t ARegister;
+  uint8_t BRegister;
+  uint8_t SumRegister;
+  uint8_t Instruction;
+  uint8_t ProgramCounter;
+  uint8_t OutRegister;
+  uint8_t ZeroFlag;
+  uint8_t CarryFlag;
+  uint8_t RAMContent[256];
+  int     cycleCounting;
+  uint8_t DebugMode;
+  uint8_t StepMode;
+  bool    isRunning;
+  char    Argument[8];
+  char    BreakReason[160];
+};
+
+atomic<unsigned int> SnapshotSequence(0);
+MachineSnapshot      PublishedSnapshot;
+
+// The screen thread sleeps until a key, a wake-up or its next
+// frame is due. The machine only wakes it up when it asked to,
+// so publishing costs no system call while the screen is busy.
+atomic<bool>          ScreenAsleep(false);
+volatile sig_atomic_t Interrupted = 0;    // CTRL-C was pressed
+
+#if defined(WIN32) && !defined(__unix__)
+  HANDLE ScreenWakeup = NULL;             // auto-reset event
+
+  bool initScreenWakeup() {
+    ScreenWakeup = CreateEvent(NULL, FALSE, FALSE, NULL);
+    return ScreenWakeup != NULL;
+  }
+
+  void wakeScreen() {
+    if (ScreenWakeup != NULL)
+      SetEvent(ScreenWakeup);
+  }
+#elif defined(__unix__) && !defined(WIN32)
+  int ScreenWakeup[2] = { -1, -1 };       // self-pipe: read & write ends
+
+  bool initScreenWakeup() {
+    if (pipe(ScreenWakeup) != 0)
+      return false;
+    fcntl(ScreenWakeup[0], F_SETFL, O_NONBLOCK);
+    fcntl(ScreenWakeup[1], F_SETFL, O_NONBLOCK);
+    return true;
+  }
+
+  // Safe in a signal handler. A full pipe already wakes the screen.
+  void wakeScreen() {
+    char byte = 0;
+    if (ScreenWakeup[1] >= 0 && write(ScreenWakeup[1], &byte, 1) < 0)
+      return;
+  }
+#else
+  bool initScreenWakeup() { return true; }
+  void wakeScreen() {}
+#endif
+
+// Machine thread only.
+void publishSnapshot() {
+  PROFILE_SCOPE(ProfilePublish);
+  unsigned int sequence = SnapshotSequence.load(memory_order_relaxed);
+  SnapshotSequence.store(sequence + 1, memory_order_relaxed);
+  atomic_thread_fence(memory_order_release);
+
+  PublishedSnapshot.MemRegister    = MemRegister;
+  PublishedSnapshot.ARegister      = ARegister;
+  PublishedSnapshot.BRegister      = BRegister;
+  PublishedSnapshot.SumRegister    = SumRegister;
+  PublishedSnapshot.Instruction    = Instruction;
+  PublishedSnapshot.ProgramCounter = ProgramCounter;
+  PublishedSnapshot.OutRegister    = OutRegister;
+  PublishedSnapshot.ZeroFlag       = ZeroFlag;
+  PublishedSnapshot.CarryFlag      = CarryFlag;
+  memcpy(PublishedSnapshot.RAMContent, RAMContent, sizeof(RAMContent));
+  PublishedSnapshot.cycleCounting  = cycleCounting;
+  PublishedSnapshot.DebugMode      = DebugMode;
+  PublishedSnapshot.StepMode       = StepMode;
+  PublishedSnapshot.isRunning      = ProgramRun;
+  snprintf(PublishedSnapshot.Argument,    sizeof(PublishedSnapshot.Argument),    "%s", Argument < 0 ? "" : to_string(Argument).c_str());
+  snprintf(PublishedSnapshot.BreakReason, sizeof(PublishedSnapshot.BreakReason), "%s", BreakReason.c_str());
+
+  SnapshotSequence.store(sequence + 2, memory_order_release);
+
+  // Pairs with the fence in runScreen(): either the screen sees
+  // this copy before it sleeps, or it is seen asleep here.
+  atomic_thread_fence(memory_order_seq_cst);
+  if (ScreenAsleep.load(memory_order_relaxed) && ScreenAsleep.exchange(false))
+    wakeScreen();
+}
+
+// Screen thread only, returns the sequence of the copy.
+unsigned int readSnapshot(MachineSnapshot &snapshot) {
+  while (true) {
+    unsigned int before = SnapshotSequence.load(memory_order_acquire);
+    if (before & 1) {
+      this_thread::yield();
+      continue;
+    }
+
+    memcpy(&snapshot, &PublishedSnapshot, sizeof(snapshot));
+    atomic_thread_fence(memory_order_acquire);
+    if (SnapshotSequence.load(memory_order_relaxed) == before)
+      return before;
+  }
+}
+
+////////////////////// Commands from the screen ////////////////////////////
+// Keys and typed commands are queued by the screen thread and
+// applied by the machine thread between micro-steps, so only
+// the machine thread ever touches the machine & debugger state.
+mutex                CommandLock;
+condition_variable   CommandArrived;
+vector<string>       PendingCommands;
+atomic<bool>         HasPendingCommands(false);
+int                  MicroStepsAllowed = 0;    // machine thread only
+
+void sendCommand(string command) {
+  lock_guard<mutex> lock(CommandLock);
+  PendingCommands.push_back(command);
+  HasPendingCommands.store(true, memory_order_release);
+  CommandArrived.notify_one();
+}
 
 ////////////////////// Screen handling ///////////////////////////////
+// Not part of the library build (-DLIBRARY), which has no screen.
+#ifndef LIBRARY
+
 // To let console know if we need to wipe the screen
 #if defined(WIN32) && !defined(__unix__)
-  uint8_t OutputMode    = SIGNED;
-  uint8_t DebugMode     = MANUAL;
-  bool    startDisplay  = true;  
   COORD   cursorPos;
 
   inline void resetCursor() {
@@ -132,12 +845,13 @@ int cycleCounting = 0;
     cout << hexAlphabet[number >> 4] << hexAlphabet[number & 0xf];
   }
 
-  inline void displayInfo() {
+  inline void displayInfo(const MachineSnapshot &snapshot) {
+    PROFILE_SCOPE(ProfileDisplay);
     cout << "[] Memory:\n";
     for (int i = 0; i < 16; ++i) {
       cout << "   ";
       for (int j = 0; j < 16; ++j) {
-        safe_printw("%02x ", RAMContent[i*16+j]);
+        safe_printw("%02x ", snapshot.RAMContent[i*16+j]);
         if (j == 7)
           cout << " ";
       }
@@ -145,192 +859,115 @@ int cycleCounting = 0;
     }
     cout << endl;
 
-    cout << "[] Mem Register    : "; outputBinary(MemRegister);    cout << "   " << "[] Ram Content  : "; outputBinary(RAMContent[MemRegister]); cout << endl;
-    cout << "[] A   Register    : "; outputBinary(ARegister);      cout << "   " << "[] B   Register : "; outputBinary(BRegister);               cout << endl;
-    cout << "[] Sum Register    : "; outputBinary(SumRegister);    cout << "   " << "(ZF: " << unsigned(ZeroFlag) << ", CF: " << unsigned(CarryFlag) << ")" << endl;
-    cout << "[] Program Counter : "; outputBinary(ProgramCounter); cout << "   " << "[] Instruction  : "; outputBinary(Instruction);
+    cout << "[] Mem Register    : "; outputBinary(snapshot.MemRegister);    cout << "   " << "[] Ram Content  : "; outputBinary(snapshot.RAMContent[snapshot.MemRegister]); cout << endl;
+    cout << "[] A   Register    : "; outputBinary(snapshot.ARegister);      cout << "   " << "[] B   Register : "; outputBinary(snapshot.BRegister);               cout << endl;
+    cout << "[] Sum Register    : "; outputBinary(snapshot.SumRegister);    cout << "   " << "(ZF: " << unsigned(snapshot.ZeroFlag) << ", CF: " << unsigned(snapshot.CarryFlag) << ")" << endl;
+    cout << "[] Program Counter : "; outputBinary(snapshot.ProgramCounter); cout << "   " << "[] Instruction  : "; outputBinary(snapshot.Instruction);
     
     cout << " -> ";
-    switch(Instruction) {
-      case LDA:
-        cout << "LDA " << Argument;
-        break;
-      case ADD:
-        cout << "ADD " << Argument;
-        break;
-      case SUB:
-        cout << "SUB " << Argument;
-        break;
-      case STA:
-        cout << "STA " << Argument;
-        break;
-      case LDI:
-        cout << "LDI " << Argument;
-        break;
-      case JMP:
-        cout << "JMP " << Argument;
-        break;
-      case JC:
-        cout << "JC " << Argument;
-        break;
-      case JZ:
-        cout << "JZ " << Argument;
-        break;
-      case AEI:
-        cout << "AEI " << Argument;
-        break;
-      case SEI:
-        cout << "SEI " << Argument;
-        break;
-      case SHL:
-        cout << "SHL " << Argument;
-        break;
-      case HLT:
-        cout << "HLT " << Argument;
-        break;
-      case _OUT:
-        cout << "OUT " << Argument;
-        break;
-      case SLF:
-        cout << "SLF " << Argument;
-        break;
-      case NOP:
-        cout << "NOP " << Argument;
-        break;
-      default:
-        cout << "Not recognized";
-        ProgramRun = 0;
-        break;
-    }
+    if (isKnownOpcode(snapshot.Instruction, ExtendedISA))
+      cout << getMnemonic(snapshot.Instruction, ExtendedISA) << " " << snapshot.Argument;
+    else
+      cout << "Not recognized";
     cout << endl;
 
     cout << ">>> Output: [[";
     if (OutputMode == SIGNED)
-      cout << signed(OutRegister);
+      cout << signed(snapshot.OutRegister);
     else
-      cout << unsigned(OutRegister);
-    cout << "]]  ";
+      cout << unsigned(snapshot.OutRegister);
+    cout << "]]  " << endl;
+
+    if (snapshot.BreakReason[0] != '\0')
+      cout << "[] Debugger: " << snapshot.BreakReason << endl;
   }
 
   void printInstruction() {
     cout << "========================================================"                << endl;
     cout << "    Press SPACE to single step the code."                                << endl;
+    cout << "    Press i / o / h to run 1 instruction / until OUT / to HLT."         << endl;
     cout << "    Press ENTER to automatically run the code. (" << CLK_SPEED << "Hz)." << endl;
+    cout << "    Press : to type a break/watch/cond/delete/step/until."               << endl;
     cout << "    Press CTRL-C to exit the program."                                   << endl;
-    cout << "    (NOTE: if you press ENTER there's no going back.)"                   << endl;
+    cout << "    (NOTE: while running, any key stops the machine.)"                  << endl;
     cout << "========================================================"                << endl;
   }
 
-  bool controlDisplay() {
-    if (DebugMode == MANUAL) {
-      FlushConsoleInputBuffer(GetStdHandle(STD_INPUT_HANDLE));
-      while (!_kbhit())
-        if (ProgramRun == 0) 
-          return false;
+  void refreshScreen() {
+    PROFILE_SCOPE(ProfileRefresh);
+    cout << flush;
+  }
 
-      char ch = _getch();
-      if (ch == ' ')
-        return true;
-      else if (ch == ENTER)
-        DebugMode = AUTO;
-      else
-        return controlDisplay();
-    }
+  // Waits for a key, a wake-up or <milliseconds> (-1: no limit),
+  // -1 if no key came.
+  int waitForKey(int milliseconds) {
+    PROFILE_SCOPE(ProfileInput);
+    if (_kbhit())
+      return _getch();
 
-    if (DebugMode == AUTO) {
-      Sleep(1000 / CLK_SPEED);
+    HANDLE handles[] = { GetStdHandle(STD_INPUT_HANDLE), ScreenWakeup };
+    WaitForMultipleObjects(2, handles, FALSE, milliseconds < 0 ? INFINITE : milliseconds);
+    if (!_kbhit()) {
+      // Mouse, focus & key-up events would keep the input signaled
+      FlushConsoleInputBuffer(handles[0]);
+      return -1;
     }
-    
-    return true;
+    return _getch();
   }
 
-  bool updateDisplay() {
-    if (startDisplay) {
-      printInstruction();
-      getStartLocation();
-      startDisplay = false;
-    }
-    else {
-      clearOutput();
-    }
+  string promptDebuggerCommand() {
+    string command;
+    cout << "(debug) ";
+    getline(cin, command);
+    return command;
+  }
 
-    displayInfo();
-    return controlDisplay();
+  void openScreen() {
+    printInstruction();
+    getStartLocation();
   }
-  
+
 #elif defined(__unix__) && !defined(WIN32)
-  uint8_t OutputMode   = SIGNED;
-  uint8_t DebugMode    = MANUAL;
-  bool    startDisplay = true;
+  bool    isScreenOpen = false;   // screen thread only
 
   #define safe_printw(...)      \
   do {                        \
-    if (ProgramRun)           \
+    if (isScreenOpen)         \
       printw(__VA_ARGS__);    \
   } while(0)                
 
   void clearOutput() {
-    if (ProgramRun) {
-      move(7, 0);
-      clrtoeol();
+    if (isScreenOpen) {
+      move(9, 0);
+      clrtobot();
     }
   }
 
-  int kbhit() {
-    int ch = getch();
-    if (ch != ERR) {
-        ungetch(ch);
-        return 1;
-    } 
-    return 0;
-  }
-
   void printInstruction() {
     safe_printw("==============================================================\n");
     safe_printw("    Press SPACE to single step the code.                      \n");
+    safe_printw("    Press i / o / h to run 1 instruction / until OUT / to HLT.\n");
     safe_printw("    Press ENTER to automatically run the code (%d Hz).        \n", CLK_SPEED);
+    safe_printw("    Press : to type a break/watch/cond/delete/step/until.     \n");
     safe_printw("    Press CTRL-C to exit the program.                         \n");
-    safe_printw("    (NOTE: if you press ENTER there's no going back.)         \n");
+    safe_printw("    (NOTE: while running, any key stops the machine.)         \n");
     safe_printw("==============================================================\n");
     safe_printw("\n");
   }
 
-  bool controlDisplay() {
-    if (DebugMode == MANUAL) {
-      while (!kbhit())
-        if (ProgramRun == 0) 
-          return false;
-
-      char ch = getch();
-      if (ch == ' ')
-        return true;
-      else if (ch == ENTER)
-        DebugMode = AUTO;
-      else
-        return controlDisplay();
-    }
-
-    if (DebugMode == AUTO) {
-      refresh();
-      fflush(stdout);
-      usleep(1000000 / CLK_SPEED);
-    }
-    
-    return true;
-  }
-
   void outputBinary(uint8_t number) {
     for (int i = 7; i >= 0; --i)
       safe_printw(((number >> i) & 0x1) ? "1" : "0");
   }
 
-  inline void displayInfo() {
+  inline void displayInfo(const MachineSnapshot &snapshot) {
+    PROFILE_SCOPE(ProfileDisplay);
     safe_printw("[] Memory:\n");
     for (int i = 0; i < 16; ++i) {
       safe_printw("   ");
       safe_printw("%02x || ", i*16);
       for (int j = 0; j < 16; ++j) {
-        safe_printw("%02x ", RAMContent[i*16+j]);
+        safe_printw("%02x ", snapshot.RAMContent[i*16+j]);
         if (j == 7)
           safe_printw(" ");
       }
@@ -338,456 +975,3172 @@ int cycleCounting = 0;
     }
     safe_printw("\n");
 
-    safe_printw("[] Mem Register    : "); outputBinary(MemRegister);    safe_printw("   "); safe_printw("[] Ram Content  : "); outputBinary(RAMContent[MemRegister]);                               safe_printw("\n");
-    safe_printw("[] A   Register    : "); outputBinary(ARegister);      safe_printw("   "); safe_printw("[] B   Register : "); outputBinary(BRegister);                                             safe_printw("\n");
-    safe_printw("[] Sum Register    : "); outputBinary(SumRegister);    safe_printw("   "); safe_printw("(ZF: "); safe_printw("%u", ZeroFlag); safe_printw(", CF: "); safe_printw("%u", CarryFlag); safe_printw(")"); safe_printw("\n");
-    safe_printw("[] Program Counter : "); outputBinary(ProgramCounter); safe_printw("   "); safe_printw("[] Instruction  : "); outputBinary(Instruction); 
+    safe_printw("[] Mem Register    : "); outputBinary(snapshot.MemRegister);    safe_printw("   "); safe_printw("[] Ram Content  : "); outputBinary(snapshot.RAMContent[snapshot.MemRegister]);                               safe_printw("\n");
+    safe_printw("[] A   Register    : "); outputBinary(snapshot.ARegister);      safe_printw("   "); safe_printw("[] B   Register : "); outputBinary(snapshot.BRegister);                                             safe_printw("\n");
+    safe_printw("[] Sum Register    : "); outputBinary(snapshot.SumRegister);    safe_printw("   "); safe_printw("(ZF: "); safe_printw("%u", snapshot.ZeroFlag); safe_printw(", CF: "); safe_printw("%u", snapshot.CarryFlag); safe_printw(")"); safe_printw("\n");
+    safe_printw("[] Program Counter : "); outputBinary(snapshot.ProgramCounter); safe_printw("   "); safe_printw("[] Instruction  : "); outputBinary(snapshot.Instruction); 
     
     safe_printw(" -> ");
-    switch(Instruction) {
-      case LDA:
-        safe_printw("LDA %s", &Argument[0]);
-        break;
-      case ADD:
-        safe_printw("ADD %s", &Argument[0]);
-        break;
-      case SUB:
-        safe_printw("SUB %s", &Argument[0]);
-        break;
-      case STA:
-        safe_printw("STA %s", &Argument[0]);
-        break;
-      case LDI:
-        safe_printw("LDI %s", &Argument[0]);
-        break;
-      case JMP:
-        safe_printw("JMP %s", &Argument[0]);
-        break;
-      case JC:
-        safe_printw("JC %s", &Argument[0]);
-        break;
-      case JZ:
-        safe_printw("JZ %s", &Argument[0]);
-        break;
-      case AEI:
-        safe_printw("AEI %s", &Argument[0]);
-        break;
-      case SEI:
-        safe_printw("SEI %s", &Argument[0]);
-        break;
-      case SHL:
-        safe_printw("SHL %s", &Argument[0]);
-        break;
-      case HLT:
-        safe_printw("HLT %s", &Argument[0]);
-        break;
-      case _OUT:
-        safe_printw("OUT %s", &Argument[0]);
-        break;
-      case SLF:
-        safe_printw("SLF %s", &Argument[0]);
-        break;
-      case NOP:
-        safe_printw("NOP %s", &Argument[0]);
-        break;
-      default:
-        safe_printw("Not recognized");
-        ProgramRun = 0;
-        break;
-    }
+    if (isKnownOpcode(snapshot.Instruction, ExtendedISA))
+      safe_printw("%s %s", getMnemonic(snapshot.Instruction, ExtendedISA), &snapshot.Argument[0]);
+    else
+      safe_printw("Not recognized");
     safe_printw("\n");
 
     safe_printw("\n");
     safe_printw(">>> Output: [[");
     if (OutputMode == SIGNED)
-      safe_printw("%d", OutRegister);
+      safe_printw("%d", snapshot.OutRegister);
     else
-      safe_printw("%u", OutRegister);
+      safe_printw("%u", snapshot.OutRegister);
     safe_printw("]]  \n");
+
+    if (snapshot.BreakReason[0] != '\0')
+      safe_printw("[] Debugger: %s\n", snapshot.BreakReason);
   }
 
-  bool updateDisplay() {
-    if (startDisplay) {
-      printInstruction();
-      // getStartLocation();
-      startDisplay = false;
-    }
-    else {
-      clearOutput();
+  void refreshScreen() {
+    PROFILE_SCOPE(ProfileRefresh);
+    refresh();
+  }
+
+  // Waits for a key, a wake-up or <milliseconds> (-1: no limit),
+  // -1 if no key came. getch() never blocks: keys ncurses already
+  // read are taken first, the terminal is only watched with poll().
+  int waitForKey(int milliseconds) {
+    PROFILE_SCOPE(ProfileInput);
+    int ch = getch();
+    if (ch != ERR)
+      return ch;
+
+    struct pollfd events[] = { { STDIN_FILENO, POLLIN, 0 }, { ScreenWakeup[0], POLLIN, 0 } };
+    if (poll(events, 2, milliseconds) <= 0)
+      return -1;
+
+    if (events[1].revents & POLLIN) {
+      char buffer[64];
+      while (read(ScreenWakeup[0], buffer, sizeof(buffer)) > 0);
     }
 
-    displayInfo();
-    return controlDisplay();
+    ch = getch();
+    return ch == ERR ? -1 : ch;
   }
-#else
-#endif
 
-////////////////////// Main loop ///////////////////////////////////
+  // Reads one command line at the bottom of the screen.
+  string promptDebuggerCommand() {
+    char buffer[128] = "";
 
-uint8_t performArithmetic(uint8_t A, uint8_t B, uint8_t &ZeroFlag, uint8_t &CarryFlag, bool SUB_FLAG, bool FLAG_IN) {
-  uint16_t A_16   = A & 0b11111111;
-  uint16_t B_16   = B & 0b11111111;
-  uint16_t result_16;
-  if (SUB_FLAG)
-    result_16 = A_16 + (~B_16 & 0b11111111) + 1;
-  else
-    result_16 = A_16 + B_16;
+    safe_printw("(debug) ");
+    echo();
+    timeout(-1);
+    getnstr(buffer, sizeof(buffer) - 1);
+    timeout(0);
+    noecho();
+    return string(buffer);
+  }
 
-  if (FLAG_IN) {
-    CarryFlag = ((result_16 >> 8) & 0x1) ^ SUB_FLAG;
-    ZeroFlag  = ((result_16 & 0b11111111) == 0);
+  void openScreen() {
+    isScreenOpen = true;
+    printInstruction();
   }
+#else
+#endif
 
-  uint8_t result_8 = result_16 & 0b11111111;
-  return result_8;
-}
+////////////////////// Screen loop ///////////////////////////////////
 
-void initRegisters() {
-  MemRegister    = 0;
-  ARegister      = 0;
-  BRegister      = 0;
-  SumRegister    = 0;
-  Instruction    = 0;
-  ProgramCounter = 0;
-  OutRegister    = 0;
-  ZeroFlag       = 0;
-  CarryFlag      = 0;
-  ProgramRun     = 1;
-}
+void handleKey(int ch, const MachineSnapshot &snapshot) {
+  bool isStopped = snapshot.DebugMode == MANUAL && snapshot.StepMode == STEP_MICRO;
+  if (!isStopped) {
+    sendCommand("stop");
+    return;
+  }
 
-bool updateMachine() {
-  cycleCounting++;
-  return updateDisplay();
+  if (ch == ' ')
+    sendCommand("next");
+  else if (ch == 'i')
+    sendCommand("step 1");
+  else if (ch == 'o')
+    sendCommand("until out");
+  else if (ch == 'h')
+    sendCommand("until hlt");
+  else if (ch == ENTER)
+    sendCommand("auto");
+  else if (ch == ':')
+    sendCommand(promptDebuggerCommand());
 }
 
-void run() {
-  initRegisters();
+// Screen thread: draws whatever the machine last published,
+// never more than SCREEN_FPS times a second. With nothing new
+// to draw it sleeps until a key, the machine or CTRL-C.
+void runScreen() {
+  MachineSnapshot snapshot;
+  unsigned int    shownSequence = 1;     // odd: nothing shown yet
+  bool            isQuitting    = false;
+  chrono::steady_clock::time_point nextFrame = chrono::steady_clock::now();
 
-  while (ProgramRun) {
-    if (!updateMachine())
-      return;
+  openScreen();
+  while (true) {
+    unsigned int sequence = readSnapshot(snapshot);
+    int          waitTime = -1;          // milliseconds, -1: no limit
+    if (sequence != shownSequence) {
+      chrono::steady_clock::time_point now = chrono::steady_clock::now();
+      if (now >= nextFrame || !snapshot.isRunning) {
+        clearOutput();
+        displayInfo(snapshot);
+        refreshScreen();
+        shownSequence = sequence;
+        nextFrame     = now + chrono::microseconds(1000000 / SCREEN_FPS);
+      }
+      else
+        waitTime = chrono::duration_cast<chrono::milliseconds>(nextFrame - now).count() + 1;
+    }
 
-    // Fetch Instruction
-    MemRegister = ProgramCounter++;
-    Instruction = RAMContent[MemRegister];
-
-    // Get arguments but for humans
-    switch(Instruction) {
-      case LDA:
-      case ADD:
-      case SUB:
-      case STA:
-      case LDI:
-      case JMP:
-      case JC:
-      case JZ:
-      case AEI:
-      case SEI:
-      case SHL:
-        Argument = to_string(RAMContent[ProgramCounter]);
-        break;
-      default:
-        Argument = "";
-    }
-
-    if (!updateMachine())
+    if (!snapshot.isRunning)
       return;
 
-    // Get arguments but for machine
-    switch(Instruction) {
-      case LDA:
-      case ADD:
-      case SUB:
-      case STA:
-      case LDI:
-      case JMP:
-      case JC:
-      case JZ:
-      case AEI:
-      case SEI:
-      case SHL:
-        MemRegister = ProgramCounter++;
-        if (!updateMachine())
-          return;
-        break;
-    }
-
-    // Handling instructions
-    switch(Instruction) {
-      case LDA:
-        MemRegister = RAMContent[MemRegister];
-        if (!updateMachine())
-          return;
-
-        ARegister = RAMContent[MemRegister];
-        SumRegister = performArithmetic(ARegister, BRegister, ZeroFlag, CarryFlag, false, false);
-        if (!updateMachine())
-          return;
-        break;
-
-      case ADD:
-        MemRegister = RAMContent[MemRegister];
-        if (!updateMachine())
-          return;
-
-        BRegister = RAMContent[MemRegister];
-        SumRegister = performArithmetic(ARegister, BRegister, ZeroFlag, CarryFlag, false, true);
-        if (!updateMachine())
-          return;
-
-        ARegister = SumRegister;
-        SumRegister = performArithmetic(ARegister, BRegister, ZeroFlag, CarryFlag, false, false);
-        if (!updateMachine())
-          return;
-        break;
-
-      case SUB:
-        MemRegister = RAMContent[MemRegister];
-        if (!updateMachine())
-          return;
-
-        BRegister = RAMContent[MemRegister];
-      	SumRegister = performArithmetic(ARegister, BRegister, ZeroFlag, CarryFlag, true, true);
-      	if (!updateMachine())
-          return;
-
-      	ARegister = SumRegister;
-      	SumRegister = performArithmetic(ARegister, BRegister, ZeroFlag, CarryFlag, false, false);
-        if (!updateMachine())
-          return;
-      	break;
-
-      case STA:
-        MemRegister = RAMContent[MemRegister];
-        if (!updateMachine())
-          return;
-
-      	RAMContent[MemRegister] = ARegister;
-      	if (!updateMachine())
-          return;
-      	break;
-
-      case LDI:
-        ARegister = RAMContent[MemRegister];
-        SumRegister = performArithmetic(ARegister, BRegister, ZeroFlag, CarryFlag, false, false);
-        if (!updateMachine())
-          return;
-        break;
-
-      case JC:
-        if (CarryFlag == 0) 
-          break;
+    if (Interrupted && !isQuitting) {
+      sendCommand("quit");
+      isQuitting = true;
+    }
 
-        ProgramCounter = RAMContent[MemRegister];
-        if (!updateMachine())
-          return;
-        break;
+    if (waitTime < 0) {
+      ScreenAsleep.store(true, memory_order_relaxed);
+      atomic_thread_fence(memory_order_seq_cst);
+      if (SnapshotSequence.load(memory_order_relaxed) != shownSequence || Interrupted) {
+        ScreenAsleep.store(false, memory_order_relaxed);
+        continue;
+      }
+    }
 
-      case JZ:
-        if (ZeroFlag == 0) 
-          break;
+    int ch = waitForKey(waitTime);
+    ScreenAsleep.store(false, memory_order_relaxed);
+    if (ch < 0 || isQuitting)
+      continue;
 
-        ProgramCounter = RAMContent[MemRegister];
-        if (!updateMachine())
-          return;
-        break;
-
-      case JMP:
-        ProgramCounter = RAMContent[MemRegister];
-        if (!updateMachine())
-          return;
-        break;
-
-      case AEI:
-        BRegister = RAMContent[MemRegister];
-        SumRegister = performArithmetic(ARegister, BRegister, ZeroFlag, CarryFlag, false, true);
-        if (!updateMachine())
-          return;
-
-        ARegister = SumRegister;
-        SumRegister = performArithmetic(ARegister, BRegister, ZeroFlag, CarryFlag, false, false);
-        if (!updateMachine())
-          return;
-        break;
-
-      case SEI:
-        BRegister = RAMContent[MemRegister];
-      	SumRegister = performArithmetic(ARegister, BRegister, ZeroFlag, CarryFlag, true, true);
-      	if (!updateMachine())
-          return;
-
-      	ARegister = SumRegister;
-      	SumRegister = performArithmetic(ARegister, BRegister, ZeroFlag, CarryFlag, false, false);
-        if (!updateMachine())
-          return;
-      	break;
-
-      case SHL:
-        MemRegister = RAMContent[MemRegister];
-        if (!updateMachine())
-          return;
-
-        ARegister = BRegister = RAMContent[MemRegister];
-        SumRegister = performArithmetic(ARegister, BRegister, ZeroFlag, CarryFlag, false, true);
-        if (!updateMachine())
-          return;
-
-        ARegister = SumRegister;
-        SumRegister = performArithmetic(ARegister, BRegister, ZeroFlag, CarryFlag, false, false);
-        if (!updateMachine())
-          return;
-        break;
-
-      case HLT:
-        ProgramRun = 0;
-        break;
-
-      case _OUT:
-        OutRegister = ARegister;
-        if (!updateMachine())
-          return;
-        break;
-
-      case SLF:
-        BRegister = ARegister;
-        SumRegister = performArithmetic(ARegister, BRegister, ZeroFlag, CarryFlag, false, true);
-        if (!updateMachine())
-          return;
-
-        ARegister = SumRegister;
-        SumRegister = performArithmetic(ARegister, BRegister, ZeroFlag, CarryFlag, false, false);
-        if (!updateMachine())
-          return;
-        break;
-
-      case NOP:
-      default:
-        break;
-    }
+    handleKey(ch, snapshot);
+    shownSequence = 1;     // the prompt may have drawn over it
   }
 }
+#endif // LIBRARY
 
-////////////////////// Initialize /////////////////////////////
-bool checkArgumentError(int argc, char* argv[]) {
-  if (argc != 2) {
-    cout << "[error] Exactly one argument required." << endl;
-    return false;
-  }
-
-  if (string(argv[1]).find(".out") == string::npos) {
-    cout << "[error] Wrong input format filename. Filename \"" << string(argv[1]) << "\" does not start with \".out\"!" << endl;
-    return false;
-  }
+////////////////////// Main loop ///////////////////////////////////
 
-  return true;
+// Makes the machine wait for the user at the next micro-step.
+void triggerBreak(string reason) {
+  BreakReason       = reason;
+  DebugMode         = MANUAL;
+  StepMode          = STEP_MICRO;
+  MicroStepsAllowed = 0;
 }
 
-// A function to keep the rule of byte code file
-bool checkByteLine(string &byteLine) {
-  // A line should have the length of 19
+// Machine thread only, with CommandLock held.
+void applyPendingCommands() {
+  for (unsigned int iCommand = 0; iCommand < PendingCommands.size(); ++iCommand) {
+    string command = PendingCommands[iCommand];
+    string errorMessage;
+    PROFILE_COUNT(ProfileCommands);
+
+    if (command == "stop") {
+      triggerBreak("stopped by user.");
+      continue;
+    }
+
+    if (command == "quit") {
+      ProgramRun = 0;
+      continue;
+    }
+
+    BreakReason = "";
+    if (command == "next")
+      MicroStepsAllowed++;
+    else if (command == "auto")
+      DebugMode = AUTO;
+    else if (!applyDebuggerCommand(command, errorMessage))
+      BreakReason = "[error] " + errorMessage;
+  }
+
+  PendingCommands.clear();
+  HasPendingCommands.store(false, memory_order_relaxed);
+}
+
+// Called between instructions, stops a step/until once
+// its target is reached. Every mode stops right before HLT
+// so the final state is still shown.
+inline void checkStepTarget() {
+  if (StepMode == STEP_MICRO)
+    return;
+
+  if (RAMContent[ProgramCounter] == HLT)
+    triggerBreak("reached HLT.");
+  else if (StepMode == STEP_INSTRUCTIONS && --InstructionsLeft <= 0)
+    triggerBreak("");
+}
+
+inline uint8_t readRAM(MachineCore &m, uint8_t address) {
+  if (WatchArmed && testAddressBit(WatchReadMap, address))
+    triggerBreak("read watchpoint at address " + to_string(address) + ".");
+  return m.RAMContent[address];
+}
+
+inline void markRAMDirty(MachineCore &m, uint8_t address) {
+  if (!testAddressBit(m.DirtyRAMMap, address)) {
+    setAddressBit(m.DirtyRAMMap, address);
+    m.DirtyRAMList[m.DirtyRAMCount++] = address;
+  }
+}
+
+inline void writeRAM(MachineCore &m, uint8_t address, uint8_t data) {
+  if (WatchArmed && testAddressBit(WatchWriteMap, address))
+    triggerBreak("write watchpoint at address " + to_string(address) + " (" + to_string(m.RAMContent[address]) + " -> " + to_string(data) + ").");
+  markRAMDirty(m, address);
+  m.RAMContent[address] = data;
+}
+
+// Only looked at between instructions.
+inline void checkBreakpoints() {
+  if (!BreakArmed)
+    return;
+
+  if (testAddressBit(BreakPCMap, ProgramCounter)) {
+    triggerBreak("breakpoint at address " + to_string(ProgramCounter) + ".");
+    return;
+  }
+
+  int iCond = checkBreakConditions();
+  if (iCond >= 0)
+    triggerBreak("condition \"" + BreakConditionTexts[iCond] + "\" holds.");
+}
+
+void initRegisters() {
+  MemRegister    = 0;
+  ARegister      = 0;
+  BRegister      = 0;
+  SumRegister    = 0;
+  Instruction    = 0;
+  ProgramCounter = 0;
+  OutRegister    = 0;
+  ZeroFlag       = 0;
+  CarryFlag      = 0;
+  MicroStep      = 0;
+  ProgramRun     = 1;
+}
+
+// Back to how the program was loaded, breakpoints aside.
+void resetMachine() {
+  for (int i = 0; i < DirtyRAMCount; ++i)
+    RAMContent[DirtyRAMList[i]] = InitialRAMContent[DirtyRAMList[i]];
+  memset(DirtyRAMMap, 0, sizeof(DirtyRAMMap));
+  DirtyRAMCount = 0;
+
+  initRegisters();
+  cycleCounting = 0;
+  OutHistory.clear();
+  StopReason  = "";
+  BreakReason = "";
+}
+
+// Adds the instruction just run to its address & opcode.
+void flushActivity(const MachineCore &m) {
+  if (ActivityStep == 0)
+    return;
+
+  ActivityCounts* totals[] = { &ActivityByAddress[ActivityAddress], &ActivityByOpcode[m.Instruction] };
+  for (ActivityCounts* counts : totals) {
+    counts->runs++;
+    counts->steps += ActivityStep;
+    for (int i = 0; i < ACTIVITY_SIGNALS; ++i)
+      counts->toggles[i] += (ActivityToggles >> (8 * i)) & 0xff;
+  }
+  ActivityStep    = 0;
+  ActivityToggles = 0;
+}
+
+inline void startActivity(const MachineCore &m) {
+  flushActivity(m);
+  ActivityAddress = m.ProgramCounter;
+}
+
+// What the micro-step just run put on the bus, read back from the
+// register it loaded (isa.h). The first one has not loaded MAR yet.
+inline uint8_t getBusValue(const MachineCore &m) {
+  if (ActivityStep == 0)
+    return m.ProgramCounter;
+
+  uint16_t signals = getMicroStep(m.Instruction, ActivityStep, ExtendedISA);
+  if (signals & MC_MI)
+    return m.MemRegister;
+  if (signals & MC_II)
+    return m.Instruction;
+  if (signals & (MC_AI | MC_RI))   // RI is AO|RI
+    return m.ARegister;
+  if (signals & MC_BI)
+    return m.BRegister;
+  if (signals & MC_OI)
+    return m.OutRegister;
+  return m.ProgramCounter;         // the jump of JC & JZ
+}
+
+// Popcount of each byte, left in that byte
+inline uint64_t countBitsByByte(uint64_t bits) {
+  bits = bits - ((bits >> 1) & 0x5555555555555555ULL);
+  bits = (bits & 0x3333333333333333ULL) + ((bits >> 2) & 0x3333333333333333ULL);
+  return (bits + (bits >> 4)) & 0x0f0f0f0f0f0f0f0fULL;
+}
+
+// The bits of each signal that changed since the last micro-step,
+// all counted at once. A byte holds the 8 micro-steps at most of
+// an instruction, so they are only taken apart in flushActivity().
+inline void countActivity(const MachineCore &m) {
+  uint64_t state = (uint64_t)m.MemRegister          | (uint64_t)m.ARegister      << 8
+                 | (uint64_t)m.BRegister     << 16  | (uint64_t)m.SumRegister    << 24
+                 | (uint64_t)m.Instruction   << 32  | (uint64_t)m.ProgramCounter << 40
+                 | (uint64_t)m.OutRegister   << 48  | (uint64_t)getBusValue(m)   << 56;
+  ActivityToggles += countBitsByByte(state ^ ActivityLast);
+  ActivityLast     = state;
+  ActivityStep++;
+}
+
+inline void mergeTaint(TaintSet &taint, const TaintSet &from) {
+  for (int i = 0; i < 4; ++i)
+    taint.bits[i] |= from.bits[i];
+}
+
+void resetTaint() {
+  for (int i = 0; i < 256; ++i) {
+    TaintRAM[i] = TaintSet();
+    setAddressBit(TaintRAM[i].bits, i);
+  }
+  TaintA = TaintB = TaintFlags = TaintControl = TaintSet();
+  TaintOutputs.clear();
+}
+
+// What the instruction at PC is about to do to the taint, from the
+// addresses it is going to use. The address an instruction reads is
+// only followed when the program wrote it (self-modifying code), so
+// plain "LDA x" does not depend on its own code. A conditional jump
+// adds the taint of the flags to every later output, taken or not.
+inline void taintInstruction(const MachineCore &m) {
+  uint8_t   opcode         = m.RAMContent[m.ProgramCounter];
+  uint8_t   operandAddress = m.ProgramCounter + 1;
+  uint8_t   address        = m.RAMContent[operandAddress];
+  TaintSet  memory         = TaintRAM[address];
+  TaintSet &immediate      = TaintRAM[isShortForm(opcode, ExtendedISA) ? m.ProgramCounter : operandAddress];
+  if (testAddressBit(m.DirtyRAMMap, operandAddress))
+    mergeTaint(memory, TaintRAM[operandAddress]);
+
+  switch (getBaseOpcode(opcode, ExtendedISA)) {
+    case LDA:
+      TaintA = memory;
+      break;
+
+    case ADD:
+    case SUB:
+      TaintB = memory;
+      mergeTaint(TaintA, TaintB);
+      TaintFlags = TaintA;
+      break;
+
+    case STA:
+      TaintRAM[address] = TaintA;
+      if (testAddressBit(m.DirtyRAMMap, operandAddress))
+        mergeTaint(TaintRAM[address], TaintRAM[operandAddress]);
+      break;
+
+    case LDI:
+      TaintA = immediate;
+      break;
+
+    case JC:
+    case JZ:
+      mergeTaint(TaintControl, TaintFlags);
+      break;
+
+    case AEI:
+    case SEI:
+      TaintB = immediate;
+      mergeTaint(TaintA, TaintB);
+      TaintFlags = TaintA;
+      break;
+
+    case SHL:
+      TaintA = TaintB = TaintFlags = memory;
+      break;
+
+    case SLF:
+      TaintB = TaintFlags = TaintA;
+      break;
+
+    case _OUT:
+      TaintOutputs.push_back({ TaintA, TaintControl });
+      break;
+  }
+}
+
+// Counts the cycle of a micro-step, stopping a batch
+// run once the budget is spent.
+inline void countCycle(MachineCore &m) {
+  m.cycleCounting++;
+  PROFILE_COUNT(ProfileMicroSteps);
+  if (ActivityMode)
+    countActivity(m);
+  if (BatchMode && m.cycleCounting >= CycleBudget) {
+    m.ProgramRun = 0;
+    m.StopReason = "budget";
+  }
+}
+
+// The register moves after a micro-step, each setting the next,
+// so an instruction can be left between any two micro-steps.
+const uint8_t MOVE_FETCH     = 0;
+const uint8_t MOVE_OPERAND   = 1;    // where the operand is
+const uint8_t MOVE_EXECUTE   = 2;    // first moves of the instruction
+const uint8_t MOVE_LOAD_A    = 3;
+const uint8_t MOVE_LOAD_B    = 4;    // then adds or subtracts
+const uint8_t MOVE_LOAD_AB   = 5;    // then adds
+const uint8_t MOVE_STORE_A   = 6;
+const uint8_t MOVE_SUM_TO_A  = 7;
+const uint8_t MOVE_END       = 8;    // none, the instruction is over
+
+// Runs the moves of NextMove, false when the instruction
+// ends with them & no micro-step follows.
+inline bool moveRegisters(MachineCore &m) {
+  switch (m.NextMove) {
+    // Fetch m.Instruction
+    case MOVE_FETCH:
+      m.MemRegister = m.ProgramCounter++;
+      m.Instruction = readRAM(m, m.MemRegister);
+      PROFILE_COUNT(ProfileOpcodes[m.Instruction]);
+
+      // Get arguments but for humans,
+      // short forms have theirs in the opcode
+      if (hasOperand(m.Instruction, ExtendedISA)) {
+        m.Argument = m.RAMContent[m.ProgramCounter];  // not a machine read
+        m.NextMove = MOVE_OPERAND;
+      }
+      else {
+        m.Argument = isShortForm(m.Instruction, ExtendedISA) ? m.Instruction & 0x0f : -1;
+        m.NextMove = MOVE_EXECUTE;
+      }
+      return true;
+
+    // Get arguments but for machine
+    case MOVE_OPERAND:
+      m.MemRegister = m.ProgramCounter++;
+      m.NextMove    = MOVE_EXECUTE;
+      return true;
+
+    case MOVE_LOAD_A:
+      m.ARegister = readRAM(m, m.MemRegister);
+      m.SumRegister = performArithmetic(m.ARegister, m.BRegister, m.ZeroFlag, m.CarryFlag, false, false);
+      m.NextMove = MOVE_END;
+      return true;
+
+    case MOVE_LOAD_B:
+      m.BRegister = readRAM(m, m.MemRegister);
+      m.SumRegister = performArithmetic(m.ARegister, m.BRegister, m.ZeroFlag, m.CarryFlag, m.Instruction == SUB, true);
+      m.NextMove = MOVE_SUM_TO_A;
+      return true;
+
+    case MOVE_LOAD_AB:
+      m.ARegister = m.BRegister = readRAM(m, m.MemRegister);
+      m.SumRegister = performArithmetic(m.ARegister, m.BRegister, m.ZeroFlag, m.CarryFlag, false, true);
+      m.NextMove = MOVE_SUM_TO_A;
+      return true;
+
+    case MOVE_STORE_A:
+      writeRAM(m, m.MemRegister, m.ARegister);
+      m.NextMove = MOVE_END;
+      return true;
+
+    case MOVE_SUM_TO_A:
+      m.ARegister = m.SumRegister;
+      m.SumRegister = performArithmetic(m.ARegister, m.BRegister, m.ZeroFlag, m.CarryFlag, false, false);
+      m.NextMove = MOVE_END;
+      return true;
+  }
+
+  // Handling instructions, MOVE_EXECUTE
+  bool    isShort      = isShortForm(m.Instruction, ExtendedISA);
+  uint8_t shortOperand = m.Instruction & 0x0f;
+  switch(getBaseOpcode(m.Instruction, ExtendedISA)) {
+    case LDA:
+      m.MemRegister = readRAM(m, m.MemRegister);
+      m.NextMove    = MOVE_LOAD_A;
+      return true;
+
+    case ADD:
+    case SUB:
+      m.MemRegister = readRAM(m, m.MemRegister);
+      m.NextMove    = MOVE_LOAD_B;
+      return true;
+
+    case STA:
+      m.MemRegister = readRAM(m, m.MemRegister);
+      m.NextMove    = MOVE_STORE_A;
+      return true;
+
+    case SHL:
+      m.MemRegister = readRAM(m, m.MemRegister);
+      m.NextMove    = MOVE_LOAD_AB;
+      return true;
+
+    case LDI:
+      m.ARegister = isShort ? shortOperand : readRAM(m, m.MemRegister);
+      m.SumRegister = performArithmetic(m.ARegister, m.BRegister, m.ZeroFlag, m.CarryFlag, false, false);
+      m.NextMove = MOVE_END;
+      return true;
+
+    case JC:
+      if (m.CarryFlag == 0) 
+        return false;
+
+      m.ProgramCounter = isShort ? shortOperand : readRAM(m, m.MemRegister);
+      m.NextMove = MOVE_END;
+      return true;
+
+    case JZ:
+      if (m.ZeroFlag == 0) 
+        return false;
+
+      m.ProgramCounter = isShort ? shortOperand : readRAM(m, m.MemRegister);
+      m.NextMove = MOVE_END;
+      return true;
+
+    case JMP:
+      m.ProgramCounter = isShort ? shortOperand : readRAM(m, m.MemRegister);
+      m.NextMove = MOVE_END;
+      return true;
+
+    case AEI:
+      m.BRegister = isShort ? shortOperand : readRAM(m, m.MemRegister);
+      m.SumRegister = performArithmetic(m.ARegister, m.BRegister, m.ZeroFlag, m.CarryFlag, false, true);
+      m.NextMove = MOVE_SUM_TO_A;
+      return true;
+
+    case SEI:
+      m.BRegister = isShort ? shortOperand : readRAM(m, m.MemRegister);
+      m.SumRegister = performArithmetic(m.ARegister, m.BRegister, m.ZeroFlag, m.CarryFlag, true, true);
+      m.NextMove = MOVE_SUM_TO_A;
+      return true;
+
+    case HLT:
+      m.ProgramRun = 0;
+      m.StopReason = "hlt";
+      return false;
+
+    case _OUT:
+      m.OutRegister = m.ARegister;
+      m.OutHistory.push_back(m.OutRegister);
+      if (StepMode == RUN_UNTIL_OUT)
+        triggerBreak("reached OUT.");
+      m.NextMove = MOVE_END;
+      return true;
+
+    case SLF:
+      m.BRegister = m.ARegister;
+      m.SumRegister = performArithmetic(m.ARegister, m.BRegister, m.ZeroFlag, m.CarryFlag, false, true);
+      m.NextMove = MOVE_SUM_TO_A;
+      return true;
+
+    case NOP:
+      return false;
+
+    default:
+      m.ProgramRun = 0;
+      m.StopReason = "unknown";
+      return false;
+  }
+}
+
+/* Moves <m> by one micro-step & returns, so whoever calls it decides
+   when the next one runs, on this machine or another one: the register
+   moves left from the last micro-step, then the cycle of the next.
+   MicroStep is back to 0 once the instruction has nothing left to do,
+   without counting a cycle when that is decided by the moves (JC & JZ
+   not taken, HLT). Activity & taint only follow MainMachine.
+   Returns whether a cycle was counted. */
+inline bool stepMachine(MachineCore &m) {
+  if (m.MicroStep == 0) {
+    if (ActivityMode)
+      startActivity(m);
+    if (TaintMode)
+      taintInstruction(m);
+    m.NextMove = MOVE_FETCH;
+  }
+  else if (!moveRegisters(m)) {
+    m.MicroStep = 0;
+    return false;
+  }
+
+  m.MicroStep = (m.NextMove == MOVE_END) ? 0 : m.MicroStep + 1;
+  countCycle(m);
+  return true;
+}
+
+// Fetches & executes one instruction, or what is left of
+// it, returning early if the machine stops in the middle.
+void runInstruction(MachineCore &m) {
+  do
+    stepMachine(m);
+  while (m.ProgramRun && m.MicroStep != 0);
+}
+
+// Machine thread of the screen, between two micro-steps: takes the
+// commands, shows the machine & waits for the user when stepping.
+void waitForScreen() {
+  if (HasPendingCommands.load(memory_order_acquire)) {
+    lock_guard<mutex> lock(CommandLock);
+    applyPendingCommands();
+  }
+
+  // Running whole instructions: only show
+  // where we are now and then.
+  if (StepMode != STEP_MICRO) {
+    if ((cycleCounting & 0xfff) == 0)
+      publishSnapshot();
+    return;
+  }
+
+  publishSnapshot();
+  if (DebugMode == AUTO) {
+    PROFILE_SCOPE(ProfileSleep);
+    this_thread::sleep_for(chrono::microseconds(1000000 / CLK_SPEED));
+    return;
+  }
+
+  // Wait until the screen thread allows the next micro-step
+  unique_lock<mutex> lock(CommandLock);
+  PROFILE_SCOPE(ProfileWait);
+  while (ProgramRun && MicroStepsAllowed == 0 && DebugMode == MANUAL && StepMode == STEP_MICRO) {
+    CommandArrived.wait(lock, [] { return HasPendingCommands.load(memory_order_relaxed); });
+    applyPendingCommands();
+    publishSnapshot();
+  }
+
+  if (MicroStepsAllowed > 0)
+    MicroStepsAllowed--;
+}
+
+void run() {
+  initRegisters();
+
+  while (ProgramRun) {
+    checkStepTarget();
+    checkBreakpoints();
+    if (BatchMode) {
+      runInstruction(MainMachine);
+      continue;
+    }
+
+    do {
+      if (stepMachine(MainMachine))
+        waitForScreen();
+    } while (ProgramRun && MicroStep != 0);
+  }
+}
+
+// Machine thread: runs the program, then tells the screen it's over.
+void runMachine() {
+  run();
+  publishSnapshot();
+}
+
+////////////////////// Result cache /////////////////////////////
+// The machine has no input, so the same image always ends the
+// same way. Results are stored in <CacheDir>/<hash>.result,
+// written to a temporary file first and renamed into place so
+// other processes only ever see complete files.
+
+inline uint64_t hashBytes(uint64_t hash, const void* data, size_t length) {
+  const uint8_t* bytes = (const uint8_t*)data;
+  for (size_t i = 0; i < length; ++i) {
+    hash ^= bytes[i];
+    hash *= 1099511628211ULL;     // FNV-1a
+  }
+  return hash;
+}
+
+string toHexString(const uint8_t* data, int length) {
+  char hexAlphabet[] = "0123456789abcdef";
+  string hexString;
+  for (int i = 0; i < length; ++i) {
+    hexString += hexAlphabet[data[i] >> 4];
+    hexString += hexAlphabet[data[i] & 0xf];
+  }
+  return hexString;
+}
+
+bool fromHexString(string hexString, uint8_t* data, int length) {
+  if ((int)hexString.length() != length * 2)
+    return false;
+  for (int i = 0; i < length; ++i) {
+    int number;
+    if (!parseNumber("0x" + hexString.substr(i * 2, 2), number))
+      return false;
+    data[i] = number;
+  }
+  return true;
+}
+
+// Everything the run depends on, in a fixed order.
+string getCacheKey() {
+  initRegisters();
+  uint8_t registers[] = { MemRegister, ARegister, BRegister, SumRegister, Instruction,
+                          ProgramCounter, OutRegister, ZeroFlag, CarryFlag };
+  return string(ENGINE_VERSION) + " " + to_string(CycleBudget) + " "
+       + toHexString(registers, sizeof(registers)) + " " + toHexString(RAMContent, 256)
+       + (ExtendedISA ? " extended" : "");
+}
+
+string getCacheFileName(string cacheKey) {
+  uint64_t hash = hashBytes(14695981039346656037ULL, &cacheKey[0], cacheKey.length());
+  uint8_t  hashBytes[8];
+  for (int i = 0; i < 8; ++i)
+    hashBytes[i] = hash >> (56 - i * 8);
+  return CacheDir + "/" + toHexString(hashBytes, 8) + ".result";
+}
+
+bool loadCachedResult(string cacheKey) {
+  fstream cacheFile;
+  string  line;
+  string  ramHex;
+  int     registers[9];
+  int     outputCount;
+
+  cacheFile.open(getCacheFileName(cacheKey), fstream::in);
+  if (!cacheFile)
+    return false;
+
+  // Hashes can collide, the full key is kept in the file.
+  if (!getline(cacheFile, line) || line != cacheKey)
+    return false;
+
+  cacheFile >> StopReason >> cycleCounting;
+  for (int i = 0; i < 9; ++i)
+    cacheFile >> registers[i];
+  cacheFile >> outputCount;
+  if (!cacheFile || outputCount < 0)
+    return false;
+
+  OutHistory.clear();
+  for (int i = 0; i < outputCount; ++i) {
+    int output;
+    cacheFile >> output;
+    OutHistory.push_back(output);
+  }
+
+  cacheFile >> ramHex >> line;
+  if (!cacheFile || line != "end" || !fromHexString(ramHex, RAMContent, 256))
+    return false;
+
+  MemRegister    = registers[0];
+  ARegister      = registers[1];
+  BRegister      = registers[2];
+  SumRegister    = registers[3];
+  Instruction    = registers[4];
+  ProgramCounter = registers[5];
+  OutRegister    = registers[6];
+  ZeroFlag       = registers[7];
+  CarryFlag      = registers[8];
+  return true;
+}
+
+bool storeCachedResult(string cacheKey) {
+  #if defined(WIN32) && !defined(__unix__)
+    CreateDirectory(CacheDir.c_str(), NULL);
+    string tempName = getCacheFileName(cacheKey) + ".tmp" + to_string(GetCurrentProcessId());
+  #else
+    mkdir(CacheDir.c_str(), 0755);
+    string tempName = getCacheFileName(cacheKey) + ".tmp" + to_string(getpid());
+  #endif
+
+  fstream cacheFile;
+  cacheFile.open(tempName, fstream::out);
+  if (!cacheFile) {
+    cout << "[error] Cannot write to cache directory \"" << CacheDir << "\"." << endl;
+    return false;
+  }
+
+  cacheFile << cacheKey << endl;
+  cacheFile << StopReason << " " << cycleCounting << endl;
+  cacheFile << unsigned(MemRegister) << " " << unsigned(ARegister)      << " " << unsigned(BRegister)   << " "
+            << unsigned(SumRegister) << " " << unsigned(Instruction)    << " " << unsigned(ProgramCounter) << " "
+            << unsigned(OutRegister) << " " << unsigned(ZeroFlag)       << " " << unsigned(CarryFlag)   << endl;
+  cacheFile << OutHistory.size();
+  for (unsigned int i = 0; i < OutHistory.size(); ++i)
+    cacheFile << " " << unsigned(OutHistory[i]);
+  cacheFile << endl;
+  cacheFile << toHexString(RAMContent, 256) << endl;
+  cacheFile << "end" << endl;
+  cacheFile.close();
+
+  if (!cacheFile || rename(tempName.c_str(), getCacheFileName(cacheKey).c_str()) != 0) {
+    remove(tempName.c_str());
+    cout << "[error] Cannot store result in cache directory \"" << CacheDir << "\"." << endl;
+    return false;
+  }
+  return true;
+}
+
+void printBatchResult(string cacheStatus) {
+  cout << "[result] stop: "    << StopReason    << endl;
+  cout << "[result] cycles: "  << cycleCounting << endl;
+  cout << "[result] outputs:";
+  for (unsigned int i = 0; i < OutHistory.size(); ++i)
+    cout << " " << unsigned(OutHistory[i]);
+  cout << endl;
+  cout << "[result] registers: MAR=" << unsigned(MemRegister) << " A=" << unsigned(ARegister)
+       << " B="   << unsigned(BRegister)      << " SUM=" << unsigned(SumRegister)
+       << " IR="  << unsigned(Instruction)    << " PC="  << unsigned(ProgramCounter)
+       << " OUT=" << unsigned(OutRegister)    << " ZF="  << unsigned(ZeroFlag)
+       << " CF="  << unsigned(CarryFlag)      << endl;
+  cout << "[result] memory:" << endl;
+  for (int i = 0; i < 16; ++i) {
+    uint8_t rowAddress = i * 16;
+    cout << "    " << toHexString(&rowAddress, 1) << " || " << toHexString(&RAMContent[i * 16], 16) << endl;
+  }
+  cout << "[result] cache: " << cacheStatus << endl;
+}
+
+// Runs the loaded program, or takes its result from the cache,
+// which knows nothing of the switching activity or taint. Returns
+// whether the cache was "hit", "miss" or "off".
+string runWithCache() {
+  string cacheKey;
+  if (CacheDir == "" || ActivityMode || TaintMode) {
+    run();
+    return "off";
+  }
+
+  cacheKey = getCacheKey();
+  if (loadCachedResult(cacheKey))
+    return "hit";
+
+  run();
+  storeCachedResult(cacheKey);
+  return "miss";
+}
+
+void runBatch() {
+  printBatchResult(runWithCache());
+}
+
+////////////////////// Debug server /////////////////////////////
+// A request is one line of commands separated by ';'. Each command
+// gets exactly one answer line, "ok ..." or "error ...", and all the
+// answers to the lines received so far go back in a single write.
+// So a client steps, reads registers & dumps memory in one round-trip.
+#if defined(__unix__) && !defined(WIN32)
+
+// Runs whole instructions until <instructions> are done, the machine
+// stops, a breakpoint holds or <maxCycles> more cycles are spent.
+// The first instruction ignores breakpoints, so stepping again
+// leaves the breakpoint it stopped at. Watchpoints let the
+// instruction touching the address finish.
+string serverRun(long instructions, int maxCycles) {
+  long long cycleLimit = (long long)cycleCounting + maxCycles;
+  BreakReason = "";
+
+  for (long i = 0; ProgramRun && i < instructions; ++i) {
+    if (cycleCounting >= cycleLimit)
+      return "ok " + to_string(cycleCounting) + " budget";
+
+    if (i > 0)
+      checkBreakpoints();
+    if (BreakReason != "")
+      break;
+
+    runInstruction(MainMachine);
+    if (BreakReason != "")
+      break;
+  }
+
+  string answer = "ok " + to_string(cycleCounting);
+  if (!ProgramRun)
+    return answer + " " + StopReason;
+  if (BreakReason != "")
+    return answer + " break " + BreakReason;
+  return answer + " paused";
+}
+
+string serverCommand(string command, bool &keepSession, bool &keepServer) {
+  stringstream ssin(command);
+  string  kind, first, second, rest;
+  int     number;
+  uint8_t address;
+
+  ssin >> kind >> first >> second >> rest;
+
+  if (kind == "step" || kind == "run") {
+    number = (kind == "step") ? 1 : CycleBudget;
+    if (second != "" || (first != "" && (!parseNumber(first, number) || number <= 0)))
+      return "error \"" + kind + "\" takes one positive number.";
+
+    if (kind == "step")
+      return serverRun(number, CycleBudget);
+    return serverRun(LONG_MAX, number);
+  }
+
+  if (kind == "regs") {
+    if (first != "")
+      return "error \"regs\" takes nothing.";
+    return "ok " + to_string(MemRegister) + " " + to_string(ARegister)
+         + " " + to_string(BRegister)     + " " + to_string(SumRegister)
+         + " " + to_string(Instruction)   + " " + to_string(ProgramCounter)
+         + " " + to_string(OutRegister)   + " " + to_string(ZeroFlag)
+         + " " + to_string(CarryFlag)     + " " + to_string(cycleCounting);
+  }
+
+  if (kind == "read") {
+    number = 1;
+    if (!parseAddress(first, address) || rest != ""
+        || (second != "" && !parseNumber(second, number)) || number <= 0 || address + number > 256)
+      return "error \"read\" takes an address & a count that stay in memory.";
+    return "ok " + toHexString(&RAMContent[address], number);
+  }
+
+  if (kind == "write") {
+    uint8_t data[256];
+    number = second.length() / 2;
+    if (!parseAddress(first, address) || rest != "" || number == 0 || address + number > 256
+        || !fromHexString(second, data, number))
+      return "error \"write\" takes an address & hex bytes that stay in memory.";
+    for (int i = 0; i < number; ++i) {
+      markRAMDirty(MainMachine, address + i);
+      RAMContent[address + i] = data[i];
+    }
+    return "ok";
+  }
+
+  if (kind == "set") {
+    uint8_t* reg = getRegisterByName(first);
+    if (reg == NULL || rest != "" || !parseNumber(second, number) || number < 0 || number > 255)
+      return "error \"set\" takes a register & a number from 0 to 255.";
+    *reg = number;
+    return "ok";
+  }
+
+  if (kind == "outputs") {
+    string answer = "ok";
+    for (unsigned int i = 0; i < OutHistory.size(); ++i)
+      answer += " " + to_string(OutHistory[i]);
+    return answer;
+  }
+
+  if (kind == "reset") {
+    resetMachine();
+    return "ok";
+  }
+
+  if (kind == "break" || kind == "watch" || kind == "rwatch" || kind == "awatch"
+      || kind == "cond" || kind == "delete") {
+    string errorMessage;
+    if (!applyDebuggerCommand(command, errorMessage))
+      return "error " + errorMessage;
+    return "ok";
+  }
+
+  if (kind == "quit" || kind == "shutdown") {
+    keepSession = false;
+    keepServer  = (kind == "quit");
+    return "ok";
+  }
+
+  return "error Unknown command \"" + kind + "\".";
+}
+
+bool writeAll(int fileDescriptor, string data) {
+  size_t written = 0;
+  while (written < data.length()) {
+    ssize_t length = write(fileDescriptor, data.data() + written, data.length() - written);
+    if (length < 0 && errno == EINTR)
+      continue;
+    if (length <= 0)
+      return false;
+    written += length;
+  }
+  return true;
+}
+
+// Answers one client until it quits or hangs up.
+void serveClient(int clientSocket, bool &keepServer) {
+  string pending;
+  char   buffer[4096];
+  bool   keepSession = true;
+
+  while (keepSession) {
+    ssize_t length = read(clientSocket, buffer, sizeof(buffer));
+    if (length < 0 && errno == EINTR)
+      continue;
+    if (length <= 0)
+      return;
+    pending.append(buffer, length);
+
+    string answers;
+    size_t lineEnd;
+    while (keepSession && (lineEnd = pending.find('\n')) != string::npos) {
+      stringstream request(pending.substr(0, lineEnd));
+      pending.erase(0, lineEnd + 1);
+
+      string command;
+      while (keepSession && getline(request, command, ';')) {
+        command.erase(0, command.find_first_not_of(" \t\r"));
+        command.erase(command.find_last_not_of(" \t\r") + 1);
+        if (command != "")
+          answers += serverCommand(command, keepSession, keepServer) + "\n";
+      }
+    }
+
+    if (answers != "" && !writeAll(clientSocket, answers))
+      return;
+  }
+}
+
+bool runServer() {
+  struct stat fileInfo;
+  if (stat(SocketPath.c_str(), &fileInfo) == 0 && !S_ISSOCK(fileInfo.st_mode)) {
+    cout << "[error] \"" << SocketPath << "\" already exists and is not a socket." << endl;
+    return false;
+  }
+
+  sockaddr_un socketAddress;
+  memset(&socketAddress, 0, sizeof(socketAddress));
+  socketAddress.sun_family = AF_UNIX;
+  if (SocketPath.length() >= sizeof(socketAddress.sun_path)) {
+    cout << "[error] Socket path \"" << SocketPath << "\" is too long." << endl;
+    return false;
+  }
+  strcpy(socketAddress.sun_path, SocketPath.c_str());
+
+  int serverSocket = socket(AF_UNIX, SOCK_STREAM, 0);
+  unlink(SocketPath.c_str());
+  if (serverSocket < 0
+      || bind(serverSocket, (sockaddr*)&socketAddress, sizeof(socketAddress)) != 0
+      || listen(serverSocket, 1) != 0) {
+    cout << "[error] Cannot listen on \"" << SocketPath << "\": " << strerror(errno) << "." << endl;
+    if (serverSocket >= 0)
+      close(serverSocket);
+    return false;
+  }
+
+  // A client leaving early must not kill the server.
+  signal(SIGPIPE, SIG_IGN);
+
+  StepMode = STEP_MICRO;
+  resetMachine();
+  cout << "[debug] Waiting for clients on \"" << SocketPath << "\"..." << endl;
+
+  bool keepServer = true;
+  while (keepServer) {
+    int clientSocket = accept(serverSocket, NULL, NULL);
+    if (clientSocket < 0) {
+      if (errno == EINTR)
+        continue;
+      break;
+    }
+    serveClient(clientSocket, keepServer);
+    close(clientSocket);
+  }
+
+  close(serverSocket);
+  unlink(SocketPath.c_str());
+  cout << "[debug] Server stopped after " << cycleCounting << " cycles." << endl;
+  return true;
+}
+
+#else
+bool runServer() {
+  cout << "[error] The debug server needs unix sockets." << endl;
+  return false;
+}
+#endif
+
+////////////////////// Divergence search /////////////////////////////
+// Both machines are compared every DIFF_CHECKPOINT cycles. Once a
+// checkpoint differs, the window is bisected, each probe starting
+// from the last state both still agreed on instead of cycle 0.
+// Probes stop after exactly as many micro-steps as machine_tick()
+// would, in the middle of an instruction if need be.
+const int DIFF_CHECKPOINT = 4096;
+
+struct MachineState {
+  uint8_t registers[9];         // MAR A B SUM IR PC OUT ZF CF
+  uint8_t RAMContent[256];
+  int     cycleCounting;
+  int     microStep;            // 0 between instructions
+  uint8_t nextMove;             // of the instruction it is in
+  int     isRunning;
+  string  StopReason;
+};
+
+const char* MachineRegisterNames[9] = { "MAR", "A", "B", "SUM", "IR", "PC", "OUT", "ZF", "CF" };
+
+void saveMachine(MachineState &state) {
+  uint8_t registers[] = { MemRegister, ARegister, BRegister, SumRegister, Instruction,
+                          ProgramCounter, OutRegister, ZeroFlag, CarryFlag };
+  memcpy(state.registers, registers, sizeof(registers));
+  memcpy(state.RAMContent, RAMContent, sizeof(RAMContent));
+  state.cycleCounting = cycleCounting;
+  state.microStep     = MicroStep;
+  state.nextMove      = NextMove;
+  state.isRunning     = ProgramRun;
+  state.StopReason    = StopReason;
+}
+
+void loadMachine(const MachineState &state) {
+  MemRegister    = state.registers[0];
+  ARegister      = state.registers[1];
+  BRegister      = state.registers[2];
+  SumRegister    = state.registers[3];
+  Instruction    = state.registers[4];
+  ProgramCounter = state.registers[5];
+  OutRegister    = state.registers[6];
+  ZeroFlag       = state.registers[7];
+  CarryFlag      = state.registers[8];
+  memcpy(RAMContent, state.RAMContent, sizeof(RAMContent));
+  cycleCounting  = state.cycleCounting;
+  MicroStep      = state.microStep;
+  NextMove       = state.nextMove;
+  ProgramRun     = state.isRunning;
+  StopReason     = state.StopReason;
+}
+
+// Moves a state forward until micro-step <cycle> has been
+// counted, or to where the machine stopped if that came first.
+void advanceMachine(MachineState &state, int cycle) {
+  loadMachine(state);
+  CycleBudget = INT_MAX;
+  while (ProgramRun && cycleCounting < cycle)
+    stepMachine(MainMachine);
+  saveMachine(state);
+}
+
+// Differences between both machines, one per line,
+// memory not compared where the images already differ.
+vector<string> compareMachines(const MachineState &a, const MachineState &b, uint64_t* ignoredMap) {
+  vector<string> differences;
+
+  if (a.isRunning != b.isRunning)
+    differences.push_back("A is " + (a.isRunning ? string("running") : "stopped (" + a.StopReason + ")")
+                        + ", B is " + (b.isRunning ? string("running") : "stopped (" + b.StopReason + ")"));
+
+  for (int i = 0; i < 9; ++i) {
+    if (a.registers[i] != b.registers[i])
+      differences.push_back(string(MachineRegisterNames[i]) + ": " + to_string(a.registers[i]) + " != " + to_string(b.registers[i]));
+  }
+
+  for (int address = 0; address < 256; ++address) {
+    if (a.RAMContent[address] != b.RAMContent[address] && !testAddressBit(ignoredMap, address))
+      differences.push_back("RAM[" + to_string(address) + "]: " + to_string(a.RAMContent[address]) + " != " + to_string(b.RAMContent[address]));
+  }
+  return differences;
+}
+
+void printDiffMachine(string name, const MachineState &state) {
+  cout << "[diff] " << name << ": PC=" << unsigned(state.registers[5]) << " IR=" << unsigned(state.registers[4])
+       << " A=" << unsigned(state.registers[1]) << " B=" << unsigned(state.registers[2])
+       << " OUT=" << unsigned(state.registers[6]) << " ZF=" << unsigned(state.registers[7])
+       << " CF=" << unsigned(state.registers[8]) << endl;
+}
+
+// Image A is in InitialRAMContent, image B in RAMContent.
+void runDiff() {
+  MachineState checkpointA, checkpointB;    // resumable, both agree up to lastEqual
+  MachineState probeA, probeB;
+  uint64_t     ignoredMap[4];
+  int          ignoredCount = 0;
+  int          maxCycles    = CycleBudget;
+  int          probeCount   = 0;
+
+  BatchMode = true;
+  memset(ignoredMap, 0, sizeof(ignoredMap));
+  for (int address = 0; address < 256; ++address) {
+    if (InitialRAMContent[address] != RAMContent[address]) {
+      setAddressBit(ignoredMap, address);
+      ignoredCount++;
+    }
+  }
+  if (ignoredCount > 0)
+    cout << "[diff] The images differ at " << ignoredCount << " addresses, memory is only compared at the others." << endl;
+
+  initRegisters();
+  cycleCounting = 0;
+  StopReason    = "";
+  saveMachine(checkpointB);
+  memcpy(RAMContent, InitialRAMContent, sizeof(RAMContent));
+  saveMachine(checkpointA);
+
+  // Look for the first checkpoint where they differ
+  int lastEqual = 0;
+  int firstDifferent = -1;
+  for (int cycle = DIFF_CHECKPOINT; firstDifferent < 0; cycle += DIFF_CHECKPOINT) {
+    cycle = min(cycle, maxCycles);
+    probeA = checkpointA;
+    probeB = checkpointB;
+    advanceMachine(probeA, cycle);
+    advanceMachine(probeB, cycle);
+    probeCount++;
+
+    if (!compareMachines(probeA, probeB, ignoredMap).empty()) {
+      firstDifferent = cycle;
+      break;
+    }
+
+    if (!probeA.isRunning && !probeB.isRunning) {
+      cout << "[diff] No difference, both stopped (" << probeA.StopReason << ") after " << probeA.cycleCounting << " cycles." << endl;
+      return;
+    }
+    if (cycle >= maxCycles) {
+      cout << "[diff] No difference in the first " << maxCycles << " cycles." << endl;
+      return;
+    }
+
+    lastEqual   = cycle;
+    checkpointA = probeA;
+    checkpointB = probeB;
+  }
+
+  // Bisect between the last equal & the first different micro-step
+  MachineState differentA = probeA, differentB = probeB;
+  while (firstDifferent - lastEqual > 1) {
+    int cycle = lastEqual + (firstDifferent - lastEqual) / 2;
+    probeA = checkpointA;
+    probeB = checkpointB;
+    advanceMachine(probeA, cycle);
+    advanceMachine(probeB, cycle);
+    probeCount++;
+
+    if (compareMachines(probeA, probeB, ignoredMap).empty()) {
+      lastEqual   = cycle;
+      checkpointA = probeA;
+      checkpointB = probeB;
+    }
+    else {
+      firstDifferent = cycle;
+      differentA     = probeA;
+      differentB     = probeB;
+    }
+  }
+
+  cout << "[diff] First difference after micro-step " << firstDifferent << " (" << probeCount << " probes):" << endl;
+  printDiffMachine("A", differentA);
+  printDiffMachine("B", differentB);
+  vector<string> differences = compareMachines(differentA, differentB, ignoredMap);
+  for (unsigned int i = 0; i < differences.size(); ++i)
+    cout << "    " << differences[i] << endl;
+}
+
+////////////////////// Library /////////////////////////////
+// The C interface of machine.h, built with -DLIBRARY. Every machine
+// is a MachineCore of its own, moved by the same functions as the
+// simulator's, so machines on different threads never wait for
+// each other. Activity, taint & the debugger stay off.
+#ifdef LIBRARY
+#include "machine.h"
+
+struct Machine {
+  MachineCore core;
+  uint8_t     image[256];
+};
+
+// The registers by number, in the order of machine.h.
+uint8_t MachineCore::* const MachineRegisters[9] = {
+  &MachineCore::MemRegister, &MachineCore::ARegister, &MachineCore::BRegister,
+  &MachineCore::SumRegister, &MachineCore::Instruction, &MachineCore::ProgramCounter,
+  &MachineCore::OutRegister, &MachineCore::ZeroFlag, &MachineCore::CarryFlag };
+
+int getMachineStatus(const MachineCore &m) {
+  if (m.ProgramRun)
+    return MACHINE_PAUSED;
+  if (m.StopReason == "hlt")
+    return MACHINE_HALTED;
+  if (m.StopReason == "unknown")
+    return MACHINE_UNKNOWN;
+  return MACHINE_PAUSED;     // cycle counter full
+}
+
+extern "C" int machine_api_version(void) {
+  return MACHINE_API_VERSION;
+}
+
+extern "C" Machine* machine_create(void) {
+  Machine* machine = new (nothrow) Machine();
+  if (machine != NULL)
+    machine_reset(machine);
+  return machine;
+}
+
+extern "C" void machine_destroy(Machine* machine) {
+  delete machine;
+}
+
+extern "C" int machine_load(Machine* machine, const uint8_t* image, size_t size) {
+  if (machine == NULL || size > sizeof(machine->image) || (image == NULL && size > 0))
+    return MACHINE_ERROR;
+
+  memset(machine->image, 0, sizeof(machine->image));
+  if (size > 0)
+    memcpy(machine->image, image, size);
+  return machine_reset(machine);
+}
+
+extern "C" int machine_reset(Machine* machine) {
+  if (machine == NULL)
+    return MACHINE_ERROR;
+
+  machine->core = MachineCore();
+  memcpy(machine->core.RAMContent, machine->image, sizeof(machine->core.RAMContent));
+  return MACHINE_PAUSED;
+}
+
+extern "C" int machine_step(Machine* machine, long instructions) {
+  if (machine == NULL || instructions < 0)
+    return MACHINE_ERROR;
+
+  MachineCore &m = machine->core;
+  for (long i = 0; m.ProgramRun && i < instructions; ++i)
+    runInstruction(m);
+  return getMachineStatus(m);
+}
+
+extern "C" int machine_run(Machine* machine, long max_cycles) {
+  if (machine == NULL || max_cycles < 0)
+    return MACHINE_ERROR;
+
+  MachineCore &m = machine->core;
+  long long cycleLimit = (long long)m.cycleCounting + max_cycles;
+  while (m.ProgramRun && m.cycleCounting < cycleLimit)
+    runInstruction(m);
+  return getMachineStatus(m);
+}
+
+extern "C" int machine_tick(Machine* machine, long micro_steps) {
+  if (machine == NULL || micro_steps < 0)
+    return MACHINE_ERROR;
+
+  MachineCore &m = machine->core;
+  long long cycleLimit = (long long)m.cycleCounting + micro_steps;
+  while (m.ProgramRun && m.cycleCounting < cycleLimit)
+    stepMachine(m);
+  return getMachineStatus(m);
+}
+
+extern "C" int machine_micro_step(const Machine* machine) {
+  if (machine == NULL)
+    return MACHINE_ERROR;
+  return machine->core.MicroStep;
+}
+
+extern "C" int machine_status(const Machine* machine) {
+  if (machine == NULL)
+    return MACHINE_ERROR;
+  return getMachineStatus(machine->core);
+}
+
+extern "C" int machine_cycles(const Machine* machine) {
+  if (machine == NULL)
+    return MACHINE_ERROR;
+  return machine->core.cycleCounting;
+}
+
+extern "C" int machine_read(const Machine* machine, int address, uint8_t* buffer, size_t count) {
+  if (machine == NULL || address < 0 || address > 256 || count > (size_t)(256 - address)
+      || (buffer == NULL && count > 0))
+    return MACHINE_ERROR;
+
+  if (count > 0)
+    memcpy(buffer, &machine->core.RAMContent[address], count);
+  return 0;
+}
+
+extern "C" int machine_write(Machine* machine, int address, const uint8_t* buffer, size_t count) {
+  if (machine == NULL || address < 0 || address > 256 || count > (size_t)(256 - address)
+      || (buffer == NULL && count > 0))
+    return MACHINE_ERROR;
+
+  if (count > 0)
+    memcpy(&machine->core.RAMContent[address], buffer, count);
+  return 0;
+}
+
+extern "C" int machine_get_register(const Machine* machine, int reg) {
+  if (machine == NULL || reg < MACHINE_MAR || reg > MACHINE_CF)
+    return MACHINE_ERROR;
+  return machine->core.*MachineRegisters[reg];
+}
+
+extern "C" int machine_set_register(Machine* machine, int reg, uint8_t value) {
+  if (machine == NULL || reg < MACHINE_MAR || reg > MACHINE_CF)
+    return MACHINE_ERROR;
+
+  machine->core.*MachineRegisters[reg] = value;
+  return 0;
+}
+
+extern "C" size_t machine_outputs(const Machine* machine, uint8_t* buffer, size_t capacity) {
+  if (machine == NULL)
+    return 0;
+
+  const vector<uint8_t> &outputs = machine->core.OutHistory;
+  size_t count = min(capacity, outputs.size());
+  if (buffer != NULL && count > 0)
+    memcpy(buffer, outputs.data(), count);
+  return outputs.size();
+}
+#endif // LIBRARY
+
+////////////////////// Symbol overrides /////////////////////////////
+string getSymbolFileName(string imageName) {
+  return imageName.substr(0, imageName.rfind('.')) + ".sym";
+}
+
+// Lines of "tag <name> <address>" & "variable <name> <address> [<initializer>]"
+bool readSymbols(string fileName, map<string, ProgramSymbol> &symbols, string &errorMessage) {
+  ifstream symbolFile(fileName);
+  if (!symbolFile) {
+    errorMessage = "Cannot read the symbol map \"" + fileName + "\", assemble the program again.";
+    return false;
+  }
+
+  string line;
+  for (int iLine = 1; getline(symbolFile, line); ++iLine) {
+    stringstream  words(line);
+    string        kind, name;
+    ProgramSymbol symbol = { -1, -1, false };
+    if (!(words >> kind))
+      continue;
+
+    symbol.isVariable = (kind == "variable");
+
+    bool isRead = (kind == "tag" || kind == "variable") && (words >> name >> symbol.address);
+    if (isRead && kind == "variable" && !(words >> symbol.initializer))
+      symbol.initializer = -1;
+    if (!isRead || symbol.address < 0 || symbol.address > 255 || symbol.initializer > 255) {
+      errorMessage = "Line " + to_string(iLine) + " of the symbol map \"" + fileName + "\" is wrong.";
+      return false;
+    }
+    symbols[name] = symbol;
+  }
+  return true;
+}
+
+// "<name>[+<offset>]=<value>", the name can be an address.
+bool parseOverride(string assignment, Override &override, string &errorMessage) {
+  size_t equal = assignment.find('=');
+  size_t plus  = assignment.find('+');
+  int    value = 0;
+
+  errorMessage = "\"" + assignment + "\" should be <name>[+<offset>]=<value>, with a value from -128 to 255.";
+  if (equal == string::npos || equal == 0 || !parseNumber(assignment.substr(equal + 1), value) || value < -128 || value > 255)
+    return false;
+
+  override.name   = assignment.substr(0, min(plus, equal));
+  override.offset = 0;
+  override.value  = value & 0xff;
+  if (plus < equal && (!parseNumber(assignment.substr(plus + 1, equal - plus - 1), override.offset) || override.offset < 0))
+    return false;
+  return override.name != "";
+}
+
+// "NAME=VALUE" lines, "#" starts a comment.
+bool readOverrideFile(string fileName, vector<Override> &overrides, string &errorMessage) {
+  ifstream overrideFile(fileName);
+  if (!overrideFile) {
+    errorMessage = "Cannot read \"" + fileName + "\".";
+    return false;
+  }
+
+  string line;
+  for (int iLine = 1; getline(overrideFile, line); ++iLine) {
+    line = line.substr(0, line.find('#'));
+    line.erase(remove_if(line.begin(), line.end(), ::isspace), line.end());
+    if (line == "")
+      continue;
+
+    Override override;
+    if (!parseOverride(line, override, errorMessage)) {
+      errorMessage = "Line " + to_string(iLine) + " of \"" + fileName + "\": " + errorMessage;
+      return false;
+    }
+    overrides.push_back(override);
+  }
+  return true;
+}
+
+/* Writes the overrides to RAMContent. A variable with an
+   initializer gets the value there too, since the program
+   would overwrite it with the one it was assembled with.
+   <symbols> is only read from <symbolFileName> when empty
+   & a name is used. */
+bool applyOverrides(const vector<Override> &overrides, map<string, ProgramSymbol> &symbols, string symbolFileName, string &errorMessage) {
+  for (unsigned int i = 0; i < overrides.size(); ++i) {
+    const Override &override    = overrides[i];
+    int             address     = 0;
+    int             initializer = -1;
+
+    if (!parseNumber(override.name, address)) {
+      if (symbols.empty() && !readSymbols(symbolFileName, symbols, errorMessage))
+        return false;
+      if (symbols.find(override.name) == symbols.end()) {
+        errorMessage = "No \"" + override.name + "\" in the symbol map.";
+        return false;
+      }
+      address = symbols[override.name].address;
+      if (override.offset == 0)
+        initializer = symbols[override.name].initializer;
+    }
+
+    address += override.offset;
+    if (address < 0 || address > 255) {
+      errorMessage = "\"" + override.name + "\" + " + to_string(override.offset) + " is outside of memory.";
+      return false;
+    }
+    RAMContent[address] = override.value;
+    if (initializer >= 0)
+      RAMContent[initializer] = override.value;
+  }
+  return true;
+}
+
+////////////////////// Initialize /////////////////////////////
+void printUsage(char* programName) {
+  cout << "[usage] " << programName << " <Program.out> [options]" << endl;
+  cout << "        " << programName << " --jobs <manifest> [--workers <n>] [--report <file>] [--parser <path>]" << endl;
+  cout << "    --break  <addr>    Stop before executing the instruction at <addr>." << endl;
+  cout << "    --watch  <addr>    Stop when <addr> is written." << endl;
+  cout << "    --rwatch <addr>    Stop when <addr> is read." << endl;
+  cout << "    --awatch <addr>    Stop when <addr> is read or written." << endl;
+  cout << "    --cond   <expr>    Stop before an instruction when <expr> holds (e.g. \"A == 0 && CF\")." << endl;
+  cout << "    --step   <n>       Start by running <n> whole instructions." << endl;
+  cout << "    --until  out|hlt   Start by running until the next OUT, or up to HLT." << endl;
+  cout << "    --batch            Run without the screen until HLT, then print the final state." << endl;
+  cout << "    --max-cycles <n>   Stop a batch run after <n> cycles (default: " << CycleBudget << ")." << endl;
+  cout << "    --extended         Run short forms of the extended ISA (operand in the low 4 bits)." << endl;
+  cout << "    --cache  <dir>     Reuse batch results of identical runs stored in <dir>." << endl;
+  cout << "    --activity <file>  Count bits flipped in registers & on the bus of a batch run, by address & opcode." << endl;
+  cout << "    --taint <file>     Find the addresses each value shown by OUT of a batch run comes from." << endl;
+  cout << "    --set <name>=<v>   Write <v> to a variable, tag or address before running (\"x=5\", \"table+2=7\")." << endl;
+  cout << "    --set-file <file>  Also apply the \"<name>=<v>\" lines of <file>." << endl;
+  cout << "    --symbols <file>   Symbol map for the names (default: the program with \".sym\")." << endl;
+  cout << "    --server <socket>  Run without the screen, driven by clients on a unix socket." << endl;
+  cout << "    --diff   <B.out>   Run <B.out> side by side & report the first micro-step where they differ." << endl;
+  cout << "    --jobs   <file>    Run every job of a manifest in parallel & report the results as JSON." << endl;
+  cout << "    --workers <n>      Number of worker processes for \"--jobs\" & \"--faults\" (default: one per CPU)." << endl;
+  cout << "    --report <file>    Write the report of \"--jobs\" or \"--faults\" there, as CSV if it ends with \".csv\"." << endl;
+  cout << "    --parser <path>    Assembler for the \".su\" jobs (default: " << ParserPath << ")." << endl;
+  cout << "    --faults <n>       Inject <n> random single-bit faults & sort out what they do." << endl;
+  cout << "    --fault  <c:t:b>   Also flip bit <b> of register or address <t> at cycle <c>." << endl;
+  cout << "    --fault-targets <list>   Where random faults go (default: " << FaultTargets << ")." << endl;
+  cout << "    --seed   <n>       Seed of the random faults (default: " << FaultSeed << ")." << endl;
+}
+
+bool parseArguments(int argc, char* argv[], string &fileName) {
+  fileName = "";
+  for (int i = 1; i < argc; ++i) {
+    string argument = string(argv[i]);
+
+    if (argument == "--batch") {
+      BatchMode = true;
+      continue;
+    }
+
+    if (argument == "--extended") {
+      ExtendedISA = true;
+      continue;
+    }
+
+    if (argument.substr(0, 2) == "--") {
+      if (i + 1 >= argc) {
+        cout << "[error] Option \"" << argument << "\" requires a value." << endl;
+        printUsage(argv[0]);
+        return false;
+      }
+
+      if (argument == "--max-cycles") {
+        if (!parseNumber(argv[++i], CycleBudget) || CycleBudget <= 0) {
+          cout << "[error] Cycle budget should be a positive number." << endl;
+          return false;
+        }
+        continue;
+      }
+
+      if (argument == "--cache") {
+        CacheDir = string(argv[++i]);
+        continue;
+      }
+
+      if (argument == "--set" || argument == "--set-file") {
+        Override override;
+        string   errorMessage;
+        if (argument == "--set" ? !parseOverride(argv[++i], override, errorMessage)
+                                : !readOverrideFile(argv[++i], Overrides, errorMessage)) {
+          cout << "[error] " << errorMessage << endl;
+          return false;
+        }
+        if (argument == "--set")
+          Overrides.push_back(override);
+        continue;
+      }
+
+      if (argument == "--symbols") {
+        SymbolFileName = string(argv[++i]);
+        continue;
+      }
+
+      if (argument == "--activity") {
+        ActivityFileName = string(argv[++i]);
+        ActivityMode     = true;
+        continue;
+      }
+
+      if (argument == "--taint") {
+        TaintFileName = string(argv[++i]);
+        TaintMode     = true;
+        continue;
+      }
+
+      if (argument == "--diff") {
+        DiffFileName = string(argv[++i]);
+        continue;
+      }
+
+      if (argument == "--server") {
+        ServerMode = true;
+        SocketPath = string(argv[++i]);
+        continue;
+      }
+
+      if (argument == "--jobs") {
+        JobsFileName = string(argv[++i]);
+        continue;
+      }
+
+      if (argument == "--report") {
+        ReportFileName = string(argv[++i]);
+        continue;
+      }
+
+      if (argument == "--parser") {
+        ParserPath = string(argv[++i]);
+        continue;
+      }
+
+      if (argument == "--faults") {
+        if (!parseNumber(argv[++i], FaultCount) || FaultCount <= 0) {
+          cout << "[error] Number of faults should be a positive number." << endl;
+          return false;
+        }
+        continue;
+      }
+
+      if (argument == "--fault") {
+        ChosenFaults.push_back(string(argv[++i]));
+        continue;
+      }
+
+      if (argument == "--fault-targets") {
+        FaultTargets = string(argv[++i]);
+        continue;
+      }
+
+      if (argument == "--seed") {
+        char* numEnd;
+        FaultSeed = strtoull(argv[++i], &numEnd, 10);
+        if (*numEnd != '\0' || argv[i][0] == '\0') {
+          cout << "[error] Seed should be a number." << endl;
+          return false;
+        }
+        continue;
+      }
+
+      if (argument == "--workers") {
+        if (!parseNumber(argv[++i], JobWorkers) || JobWorkers <= 0) {
+          cout << "[error] Number of workers should be a positive number." << endl;
+          return false;
+        }
+        continue;
+      }
+
+      string errorMessage;
+      if (!applyDebuggerCommand(argument.substr(2) + " " + string(argv[++i]), errorMessage)) {
+        cout << "[error] " << errorMessage << endl;
+        printUsage(argv[0]);
+        return false;
+      }
+      continue;
+    }
+
+    if (fileName != "") {
+      cout << "[error] Exactly one program file required." << endl;
+      printUsage(argv[0]);
+      return false;
+    }
+    fileName = argument;
+  }
+
+  bool isFaultMode = FaultCount > 0 || !ChosenFaults.empty();
+  if (BatchMode + ServerMode + (DiffFileName != "") + (JobsFileName != "") + isFaultMode > 1) {
+    cout << "[error] Only one of \"--batch\", \"--server\", \"--diff\", \"--jobs\" and \"--faults\" can be used." << endl;
+    return false;
+  }
+
+  if (ActivityMode && !BatchMode) {
+    cout << "[error] \"--activity\" needs \"--batch\"." << endl;
+    return false;
+  }
+
+  if (TaintMode && !BatchMode) {
+    cout << "[error] \"--taint\" needs \"--batch\"." << endl;
+    return false;
+  }
+
+  // The jobs name their own programs.
+  if (JobsFileName != "") {
+    if (fileName != "") {
+      cout << "[error] \"--jobs\" takes no program file." << endl;
+      return false;
+    }
+    if (!Overrides.empty()) {
+      cout << "[error] Jobs take \"set=<name>=<value>\" in the manifest instead of \"--set\"." << endl;
+      return false;
+    }
+    return true;
+  }
+
+  if (fileName == "") {
+    cout << "[error] Exactly one program file required." << endl;
+    printUsage(argv[0]);
+    return false;
+  }
+
+  if (fileName.find(".out") == string::npos) {
+    cout << "[error] Wrong input format filename. Filename \"" << fileName << "\" does not start with \".out\"!" << endl;
+    return false;
+  }
+
+  return true;
+}
+
+// A function to keep the rule of byte code file
+bool checkByteLine(string &byteLine) {
+  // A line should have the length of 19
   if (byteLine.length() != 19) 
     return false;
 
-  // 8 first & last characters are binary code, seperated by a " | "
-  for (unsigned int i = 0; i < byteLine.length(); ++i) {
-    if ((i <= 7 || i >= 11) && (byteLine[i] != '1' && byteLine[i] != '0')) return false;
-    if ((i == 8 || i == 10) && (byteLine[i] != ' '))                       return false;
-    if ((i == 9)            && (byteLine[i] != '|'))                       return false;
+  // 8 first & last characters are binary code, seperated by a " | "
+  for (unsigned int i = 0; i < byteLine.length(); ++i) {
+    if ((i <= 7 || i >= 11) && (byteLine[i] != '1' && byteLine[i] != '0')) return false;
+    if ((i == 8 || i == 10) && (byteLine[i] != ' '))                       return false;
+    if ((i == 9)            && (byteLine[i] != '|'))                       return false;
+  }
+
+  byteLine.erase(0, 11);
+  return true;
+}
+
+uint8_t extractData(string byteLine) {
+  uint8_t argumentData = 0;
+  for (int i = 0; i < 8; ++i) {
+    if (byteLine[i] == '1') 
+      argumentData |= (1 << (7 - i));
+  }
+  return argumentData;
+}
+
+bool checkData(string filename) {
+  cout << "[debug] Checking validity of file..." << endl;
+
+  fstream byteFile;             // open machine code file
+  string  byteLine;             // line of byte code
+
+  byteFile.open(filename, fstream::in);
+  if (!byteFile) {
+    cout << "[error] Cannot open code file \"" << filename << "\"!" << endl;
+    return false;
+  }
+
+  for (int i = 0; i < 256; ++i) {
+    if (byteFile.eof()) {
+      cout << "[error] Insufficient amount of byte code!" << endl;
+      return false;
+    }
+
+    getline(byteFile, byteLine);
+    if (!checkByteLine(byteLine)) {
+      cout << "[error] Wrong format for the file!" << endl;
+      return false;
+    }
+
+    // Get data, simple
+    RAMContent[i] = extractData(byteLine);
+  }
+
+  cout << "[debug] File ready to run." << endl;
+  return true;
+}
+
+#ifndef LIBRARY
+bool initScreen() {
+  initscr();
+
+  cbreak();
+  noecho();
+  timeout(0);              // keys are waited for with poll()
+
+  scrollok(stdscr, TRUE);
+  return initScreenWakeup();
+}
+#endif
+
+////////////////////// Job runner /////////////////////////////
+// A manifest has one job per line, a program & its options:
+//     <file.su|file.out> [name=<id>] [max-cycles=<n>] [isa=base|extended] [patch=<addr>:<hex>]... [set=<name>=<v>]... [expect=<v>,<v>,...]
+// Files are relative to the manifest. Workers are forked &
+// take the next job from a counter they share, so a slow job
+// never holds the others back. Each one sends its results as
+// lines through its own pipe.
+#if defined(__unix__) && !defined(WIN32)
+
+struct RAMPatch {
+  uint8_t         address;
+  vector<uint8_t> data;
+};
+
+struct Job {
+  string           name;
+  string           fileName;
+  int              cycleBudget;
+  bool             extended;       // assembled & run with the short forms
+  vector<RAMPatch> patches;
+  vector<Override> overrides;
+  bool             hasExpected;
+  vector<uint8_t>  expected;
+};
+
+struct JobResult {
+  string          status;         // "pass", "fail" or "error"
+  string          stop;
+  int             cycles;
+  double          milliseconds;
+  vector<uint8_t> outputs;
+  string          message;
+};
+
+bool parseJobOption(string option, Job &job, string &errorMessage) {
+  size_t equal = option.find('=');
+  string key   = option.substr(0, equal);
+  string value = (equal == string::npos) ? "" : option.substr(equal + 1);
+
+  if (equal == string::npos) {
+    errorMessage = "Option \"" + option + "\" has no value.";
+    return false;
+  }
+
+  if (key == "name") {
+    job.name = value;
+    return true;
+  }
+
+  if (key == "max-cycles") {
+    if (!parseNumber(value, job.cycleBudget) || job.cycleBudget <= 0) {
+      errorMessage = "Cycle budget should be a positive number.";
+      return false;
+    }
+    return true;
+  }
+
+  if (key == "isa") {
+    if (value != "base" && value != "extended") {
+      errorMessage = "\"isa\" is either \"base\" or \"extended\".";
+      return false;
+    }
+    job.extended = (value == "extended");
+    return true;
+  }
+
+  if (key == "patch") {
+    RAMPatch patch;
+    size_t   colon = value.find(':');
+    string   bytes = (colon == string::npos) ? "" : value.substr(colon + 1);
+    patch.data.resize(bytes.length() / 2);
+    if (colon == string::npos || !parseAddress(value.substr(0, colon), patch.address) || patch.data.empty()
+        || patch.address + patch.data.size() > 256 || !fromHexString(bytes, &patch.data[0], patch.data.size())) {
+      errorMessage = "\"patch\" takes <addr>:<hex bytes> that stay in memory.";
+      return false;
+    }
+    job.patches.push_back(patch);
+    return true;
+  }
+
+  if (key == "set") {
+    Override override;
+    if (!parseOverride(value, override, errorMessage))
+      return false;
+    job.overrides.push_back(override);
+    return true;
+  }
+
+  if (key == "expect") {
+    stringstream values(value);
+    string       number;
+    job.hasExpected = true;
+    job.expected.clear();
+    while (getline(values, number, ',')) {
+      uint8_t output;
+      if (!parseAddress(number, output)) {
+        errorMessage = "\"expect\" takes numbers from 0 to 255, separated by commas.";
+        return false;
+      }
+      job.expected.push_back(output);
+    }
+    return true;
+  }
+
+  errorMessage = "Unknown option \"" + key + "\".";
+  return false;
+}
+
+bool readJobs(string manifestName, vector<Job> &jobs) {
+  fstream manifest;
+  string  line;
+  string  directory;
+
+  manifest.open(manifestName, fstream::in);
+  if (!manifest) {
+    cout << "[error] Cannot open manifest \"" << manifestName << "\"!" << endl;
+    return false;
+  }
+
+  if (manifestName.rfind('/') != string::npos)
+    directory = manifestName.substr(0, manifestName.rfind('/') + 1);
+
+  for (int lineNumber = 1; getline(manifest, line); ++lineNumber) {
+    if (line.find('#') != string::npos)
+      line.erase(line.find('#'));
+
+    stringstream words(line);
+    string       option;
+    Job          job;
+    if (!(words >> job.fileName))
+      continue;
+
+    job.name        = job.fileName;
+    job.cycleBudget = CycleBudget;
+    job.extended    = ExtendedISA;
+    job.hasExpected = false;
+    if (job.fileName[0] != '/')
+      job.fileName = directory + job.fileName;
+
+    while (words >> option) {
+      string errorMessage;
+      if (!parseJobOption(option, job, errorMessage)) {
+        cout << "[error] " << manifestName << ":" << lineNumber << ": " << errorMessage << endl;
+        return false;
+      }
+    }
+    jobs.push_back(job);
+  }
+  return true;
+}
+
+// The first "[error]" line of some program output, without the tag.
+string getErrorLine(string text) {
+  stringstream lines(text);
+  string       line;
+  while (getline(lines, line)) {
+    if (line.substr(0, 8) == "[error] ")
+      return line.substr(8);
+  }
+  return "";
+}
+
+string JobTempDir;      // Holds a directory per ".su" job
+map<string, vector<uint8_t> > AssembledImages;   // Per worker, by source & ISA
+map<string, map<string, ProgramSymbol> > AssembledSymbols;   // Same, for the "set=" of the jobs
+
+// Runs the assembler on a link to <sourceName> in a directory of the
+// job, so jobs sharing a source never write the same image and the
+// directory of the source is left alone.
+bool assembleSource(string sourceName, string linkName, string &errorMessage) {
+  char* sourcePath = realpath(sourceName.c_str(), NULL);
+  if (sourcePath == NULL) {
+    errorMessage = "Cannot open source file \"" + sourceName + "\"!";
+    return false;
+  }
+
+  mkdir(linkName.substr(0, linkName.rfind('/')).c_str(), 0700);
+  bool isLinked = (symlink(sourcePath, linkName.c_str()) == 0);
+  free(sourcePath);
+  if (!isLinked) {
+    errorMessage = "Cannot link \"" + sourceName + "\" in \"" + JobTempDir + "\".";
+    return false;
+  }
+
+  int output[2];
+  if (pipe(output) != 0) {
+    errorMessage = "Cannot start the assembler.";
+    return false;
+  }
+
+  pid_t pid = fork();
+  if (pid == 0) {
+    dup2(output[1], STDOUT_FILENO);
+    dup2(output[1], STDERR_FILENO);
+    close(output[0]);
+    close(output[1]);
+    if (ExtendedISA)
+      execlp(ParserPath.c_str(), ParserPath.c_str(), "--extended", linkName.c_str(), (char*)NULL);
+    else
+      execlp(ParserPath.c_str(), ParserPath.c_str(), linkName.c_str(), (char*)NULL);
+    _exit(127);
+  }
+  close(output[1]);
+
+  string  text;
+  char    buffer[4096];
+  ssize_t length;
+  while ((length = read(output[0], buffer, sizeof(buffer))) > 0)
+    text.append(buffer, length);
+  close(output[0]);
+
+  int status = 0;
+  if (pid < 0 || waitpid(pid, &status, 0) < 0 || !WIFEXITED(status)) {
+    errorMessage = "Cannot run the assembler \"" + ParserPath + "\".";
+    return false;
+  }
+  if (WEXITSTATUS(status) == 127) {
+    errorMessage = "Cannot find the assembler \"" + ParserPath + "\", see \"--parser\".";
+    return false;
+  }
+  if (WEXITSTATUS(status) != 0) {
+    errorMessage = getErrorLine(text);
+    if (errorMessage == "")
+      errorMessage = "The assembler failed.";
+    return false;
+  }
+  return true;
+}
+
+string getOutputName(string sourceName) {
+  return sourceName.substr(0, sourceName.rfind('.')) + ".out";
+}
+
+void runJob(int index, const Job &job, JobResult &result) {
+  chrono::steady_clock::time_point start = chrono::steady_clock::now();
+  result.stop   = "";
+  result.cycles = 0;
+  result.outputs.clear();
+
+  // Only the errors of checkData() are kept.
+  stringstream log;
+  streambuf*   coutBuffer = cout.rdbuf(log.rdbuf());
+  string       imageName  = job.fileName;
+  string       linkName   = "";
+  string       sourceKey  = job.fileName + (job.extended ? " extended" : "");
+  bool         isLoaded   = true;
+
+  ExtendedISA = job.extended;
+  bool isSource = imageName.length() > 3 && imageName.substr(imageName.length() - 3) == ".su";
+  if (isSource && AssembledImages.count(sourceKey) > 0)
+    memcpy(RAMContent, &AssembledImages[sourceKey][0], sizeof(RAMContent));
+  else {
+    if (isSource) {
+      linkName  = JobTempDir + "/" + to_string(index) + "/" + imageName.substr(imageName.rfind('/') + 1);
+      isLoaded  = assembleSource(imageName, linkName, result.message);
+      imageName = getOutputName(linkName);
+    }
+    if (isLoaded && !checkData(imageName)) {
+      isLoaded       = false;
+      result.message = getErrorLine(log.str());
+    }
+
+    if (isSource) {
+      string symbolFileName = getSymbolFileName(imageName);
+      string ignored;
+      if (isLoaded)
+        readSymbols(symbolFileName, AssembledSymbols[sourceKey], ignored);
+      unlink(linkName.c_str());
+      unlink(imageName.c_str());
+      unlink(symbolFileName.c_str());
+      rmdir(linkName.substr(0, linkName.rfind('/')).c_str());
+      if (isLoaded)
+        AssembledImages[sourceKey].assign(RAMContent, RAMContent + sizeof(RAMContent));
+    }
+  }
+
+  if (isLoaded) {
+    map<string, ProgramSymbol> imageSymbols;
+    isLoaded = applyOverrides(job.overrides, isSource ? AssembledSymbols[sourceKey] : imageSymbols,
+                              getSymbolFileName(job.fileName), result.message);
+  }
+
+  if (isLoaded) {
+    for (unsigned int i = 0; i < job.patches.size(); ++i)
+      memcpy(&RAMContent[job.patches[i].address], &job.patches[i].data[0], job.patches[i].data.size());
+    memcpy(InitialRAMContent, RAMContent, sizeof(RAMContent));
+    resetMachine();
+
+    BatchMode   = true;
+    CycleBudget = job.cycleBudget;
+    runWithCache();
+  }
+  cout.rdbuf(coutBuffer);
+
+  result.milliseconds = chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now() - start).count() / 1000.0;
+  if (!isLoaded) {
+    result.status = "error";
+    return;
+  }
+
+  result.stop    = StopReason;
+  result.cycles  = cycleCounting;
+  result.outputs = OutHistory;
+  result.status  = "fail";
+
+  if (StopReason == "budget")
+    result.message = "Did not halt within " + to_string(job.cycleBudget) + " cycles.";
+  else if (StopReason == "unknown")
+    result.message = "Ran into an unknown opcode at address " + to_string(ProgramCounter - 1) + ".";
+  else if (job.hasExpected && OutHistory != job.expected) {
+    unsigned int i = 0;
+    while (i < OutHistory.size() && i < job.expected.size() && OutHistory[i] == job.expected[i])
+      ++i;
+    if (i < OutHistory.size() && i < job.expected.size())
+      result.message = "Output #" + to_string(i + 1) + " is " + to_string(OutHistory[i])
+                     + ", expected " + to_string(job.expected[i]) + ".";
+    else
+      result.message = to_string(OutHistory.size()) + " outputs, expected " + to_string(job.expected.size()) + ".";
+  }
+  else {
+    result.status  = "pass";
+    result.message = "";
+  }
+}
+
+string joinOutputs(const vector<uint8_t> &outputs, string separator) {
+  string text;
+  for (unsigned int i = 0; i < outputs.size(); ++i)
+    text += (i > 0 ? separator : "") + to_string(outputs[i]);
+  return text;
+}
+
+// One line: status, stop, cycles, milliseconds, outputs & message.
+string encodeJobResult(const JobResult &result) {
+  string message = result.message;
+  for (unsigned int i = 0; i < message.length(); ++i)
+    if (message[i] == '\t' || message[i] == '\n')
+      message[i] = ' ';
+
+  stringstream line;
+  line << result.status << "\t" << result.stop << "\t" << result.cycles << "\t"
+       << result.milliseconds << "\t" << joinOutputs(result.outputs, ",") << "\t" << message;
+  return line.str();
+}
+
+bool decodeJobResult(string line, JobResult &result) {
+  stringstream fields(line);
+  string       field[6];
+  for (int i = 0; i < 6; ++i)
+    getline(fields, field[i], '\t');
+
+  stringstream outputs(field[4]);
+  string       output;
+  result.outputs.clear();
+  while (getline(outputs, output, ','))
+    result.outputs.push_back(atoi(output.c_str()));
+
+  result.status       = field[0];
+  result.stop         = field[1];
+  result.cycles       = atoi(field[2].c_str());
+  result.milliseconds = atof(field[3].c_str());
+  result.message      = field[5];
+  return result.status != "";
+}
+
+string quoteJSON(string text) {
+  string quoted = "\"";
+  for (unsigned int i = 0; i < text.length(); ++i) {
+    unsigned char ch = text[i];
+    if (ch == '"' || ch == '\\')
+      quoted += string("\\") + text[i];
+    else if (ch < 0x20) {
+      char escaped[8];
+      snprintf(escaped, sizeof(escaped), "\\u%04x", ch);
+      quoted += escaped;
+    }
+    else
+      quoted += text[i];
+  }
+  return quoted + "\"";
+}
+
+string quoteCSV(string text) {
+  if (text.find_first_of(",\"\n") == string::npos)
+    return text;
+
+  string quoted = "\"";
+  for (unsigned int i = 0; i < text.length(); ++i)
+    quoted += (text[i] == '"') ? string("\"\"") : string(1, text[i]);
+  return quoted + "\"";
+}
+
+void writeJSONReport(ostream &report, const vector<Job> &jobs, const vector<JobResult> &results,
+                     int counts[3], double milliseconds) {
+  report << "{" << endl;
+  report << "  \"jobs\": "    << jobs.size()  << "," << endl;
+  report << "  \"passed\": "  << counts[0]    << "," << endl;
+  report << "  \"failed\": "  << counts[1]    << "," << endl;
+  report << "  \"errors\": "  << counts[2]    << "," << endl;
+  report << "  \"wall_ms\": " << milliseconds << "," << endl;
+  report << "  \"results\": [" << endl;
+  for (unsigned int i = 0; i < jobs.size(); ++i) {
+    const JobResult &result = results[i];
+    report << "    { \"name\": "   << quoteJSON(jobs[i].name)
+           << ", \"file\": "       << quoteJSON(jobs[i].fileName)
+           << ", \"status\": "     << quoteJSON(result.status)
+           << ", \"stop\": "       << quoteJSON(result.stop)
+           << ", \"cycles\": "     << result.cycles
+           << ", \"ms\": "         << result.milliseconds
+           << ", \"outputs\": ["   << joinOutputs(result.outputs, ", ") << "]"
+           << ", \"expected\": ";
+    if (jobs[i].hasExpected)
+      report << "[" << joinOutputs(jobs[i].expected, ", ") << "]";
+    else
+      report << "null";
+    report << ", \"message\": " << quoteJSON(result.message) << " }"
+           << (i + 1 < jobs.size() ? "," : "") << endl;
+  }
+  report << "  ]" << endl;
+  report << "}" << endl;
+}
+
+void writeCSVReport(ostream &report, const vector<Job> &jobs, const vector<JobResult> &results) {
+  report << "name,file,status,stop,cycles,ms,outputs,expected,message" << endl;
+  for (unsigned int i = 0; i < jobs.size(); ++i) {
+    const JobResult &result = results[i];
+    report << quoteCSV(jobs[i].name) << "," << quoteCSV(jobs[i].fileName) << ","
+           << result.status << "," << result.stop << "," << result.cycles << ","
+           << result.milliseconds << "," << joinOutputs(result.outputs, " ") << ","
+           << (jobs[i].hasExpected ? joinOutputs(jobs[i].expected, " ") : "") << ","
+           << quoteCSV(result.message) << endl;
+  }
+}
+
+// Forks the workers, which take the next task from a counter they
+// share, so each one gets its tasks in increasing order. What
+// <runTask> returns (one line) comes back in <results> by task,
+// "" for a task its worker died on. Returns how many workers ran.
+int runWorkers(int taskCount, function<string(int)> runTask, vector<string> &results) {
+  int workerCount = JobWorkers > 0 ? JobWorkers : max(1u, thread::hardware_concurrency());
+  workerCount = max(1, min(workerCount, taskCount));
+  results.assign(taskCount, "");
+
+  atomic<int>* nextTask = (atomic<int>*)mmap(NULL, sizeof(atomic<int>), PROT_READ | PROT_WRITE,
+                                             MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+  if (nextTask == MAP_FAILED) {
+    cout << "[error] Cannot share memory with the workers." << endl;
+    return 0;
+  }
+  new (nextTask) atomic<int>(0);
+
+  vector<pid_t>         workers;
+  vector<struct pollfd> pipes;
+  vector<string>        received;
+  cout << flush;
+  for (int iWorker = 0; iWorker < workerCount; ++iWorker) {
+    int output[2];
+    if (pipe(output) != 0)
+      break;
+
+    pid_t pid = fork();
+    if (pid == 0) {
+      for (unsigned int i = 0; i < pipes.size(); ++i)
+        close(pipes[i].fd);
+      close(output[0]);
+
+      int task;
+      while ((task = nextTask->fetch_add(1)) < taskCount) {
+        if (!writeAll(output[1], to_string(task) + "\t" + runTask(task) + "\n"))
+          break;
+      }
+      _exit(0);
+    }
+
+    close(output[1]);
+    if (pid < 0) {
+      close(output[0]);
+      break;
+    }
+    workers.push_back(pid);
+    pipes.push_back({ output[0], POLLIN, 0 });
+    received.push_back("");
+  }
+
+  // Read until every worker closed its pipe.
+  unsigned int openPipes = pipes.size();
+  while (openPipes > 0) {
+    if (poll(&pipes[0], pipes.size(), -1) < 0 && errno != EINTR)
+      break;
+
+    for (unsigned int i = 0; i < pipes.size(); ++i) {
+      if (pipes[i].fd < 0 || pipes[i].revents == 0)
+        continue;
+
+      char    buffer[65536];
+      ssize_t length = read(pipes[i].fd, buffer, sizeof(buffer));
+      if (length > 0)
+        received[i].append(buffer, length);
+      else if (length == 0 || errno != EINTR) {
+        close(pipes[i].fd);
+        pipes[i].fd = -1;
+        openPipes--;
+      }
+    }
+  }
+
+  for (unsigned int i = 0; i < workers.size(); ++i)
+    waitpid(workers[i], NULL, 0);
+  munmap(nextTask, sizeof(atomic<int>));
+
+  for (unsigned int i = 0; i < received.size(); ++i) {
+    stringstream lines(received[i]);
+    string       line;
+    while (getline(lines, line)) {
+      size_t tab  = line.find('\t');
+      int    task = atoi(line.substr(0, tab).c_str());
+      if (tab != string::npos && task >= 0 && task < taskCount)
+        results[task] = line.substr(tab + 1);
+    }
+  }
+
+  if (workers.empty())
+    cout << "[error] Cannot start any worker." << endl;
+  return workers.size();
+}
+
+// Returns 0 when every job passed, 1 when some did not,
+// -5 if the jobs could not be run.
+int runJobs() {
+  vector<Job> jobs;
+  if (!readJobs(JobsFileName, jobs))
+    return -5;
+
+  chrono::steady_clock::time_point start = chrono::steady_clock::now();
+  const char* tempRoot = getenv("TMPDIR");
+  string      tempName = string(tempRoot != NULL ? tempRoot : "/tmp") + "/run-jobs-XXXXXX";
+  if (mkdtemp(&tempName[0]) == NULL) {
+    cout << "[error] Cannot create a directory in \"" << tempName.substr(0, tempName.rfind('/')) << "\"." << endl;
+    return -5;
+  }
+  JobTempDir = tempName;
+
+  vector<string> lines;
+  int workerCount = runWorkers(jobs.size(), [&jobs](int index) {
+    JobResult result;
+    runJob(index, jobs[index], result);
+    return encodeJobResult(result);
+  }, lines);
+  rmdir(JobTempDir.c_str());
+  if (workerCount == 0)
+    return -5;
+
+  // A job a worker died on never gets a line.
+  vector<JobResult> results(jobs.size());
+  for (unsigned int i = 0; i < jobs.size(); ++i) {
+    if (decodeJobResult(lines[i], results[i]))
+      continue;
+    results[i].status       = "error";
+    results[i].stop         = "";
+    results[i].cycles       = 0;
+    results[i].milliseconds = 0;
+    results[i].outputs.clear();
+    results[i].message      = "The worker running it died.";
+  }
+
+  int counts[3] = { 0, 0, 0 };      // passed, failed & errors
+  for (unsigned int i = 0; i < results.size(); ++i)
+    counts[results[i].status == "pass" ? 0 : (results[i].status == "fail" ? 1 : 2)]++;
+  double milliseconds = chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now() - start).count() / 1000.0;
+
+  bool isCSV = ReportFileName.length() > 4 && ReportFileName.substr(ReportFileName.length() - 4) == ".csv";
+  if (ReportFileName == "") {
+    writeJSONReport(cout, jobs, results, counts, milliseconds);
+  }
+  else {
+    fstream report;
+    report.open(ReportFileName, fstream::out);
+    if (isCSV)
+      writeCSVReport(report, jobs, results);
+    else
+      writeJSONReport(report, jobs, results, counts, milliseconds);
+    report.close();
+
+    if (!report) {
+      cout << "[error] Cannot write report \"" << ReportFileName << "\"." << endl;
+      return -5;
+    }
+    cout << "[jobs] " << jobs.size() << " jobs on " << workerCount << " workers in " << milliseconds << " ms: "
+         << counts[0] << " passed, " << counts[1] << " failed, " << counts[2] << " errors." << endl;
+  }
+  return (counts[1] + counts[2] == 0) ? 0 : 1;
+}
+
+#else
+int runJobs() {
+  cout << "[error] The job runner needs a unix system." << endl;
+  return -5;
+}
+#endif
+
+////////////////////// Fault injection /////////////////////////////
+// The program is first run without faults, the golden run. The
+// faults are sorted by cycle & cut in chunks the workers take in
+// increasing order. Each worker moves its own golden machine forward
+// to the next fault & runs the faulty machine from a copy of it,
+// instead of replaying from cycle 0. A fault lands right after the
+// micro-step of its cycle, in the middle of an instruction if need be.
+#if defined(__unix__) && !defined(WIN32)
+
+const int   FAULT_REGISTER = 256;      // Targets below are RAM addresses
+const int   FAULT_CHUNK    = 64;       // Faults per task of a worker
+const char* FaultOutcomeNames[4] = { "same", "wrong", "hang", "crash" };
+
+struct Fault {
+  int     cycle;
+  int     target;      // RAM address, or FAULT_REGISTER + register
+  uint8_t bit;
+};
+
+struct FaultResult {
+  int             outcome;
+  string          stop;
+  int             cycles;
+  vector<uint8_t> outputs;
+};
+
+MachineState    FaultGolden;           // Per worker, only moves forward
+vector<uint8_t> GoldenOutputs;
+string          GoldenStop;
+int             FaultBudget;
+
+string getFaultTargetName(int target) {
+  if (target < FAULT_REGISTER) {
+    uint8_t address = target;
+    return "RAM[0x" + toHexString(&address, 1) + "]";
+  }
+  return MachineRegisterNames[target - FAULT_REGISTER];
+}
+
+int findRegisterIndex(string regName) {
+  for (unsigned int i = 0; i < regName.length(); ++i)
+    regName[i] = toupper(regName[i]);
+  for (int i = 0; i < 9; ++i)
+    if (regName == MachineRegisterNames[i])
+      return i;
+  return -1;
+}
+
+// "<cycle>:<target>:<bit>", the target a register or a RAM address.
+bool parseFault(string spec, Fault &fault, string &errorMessage) {
+  stringstream fields(spec);
+  string       field[3];
+  int          number;
+  uint8_t      address;
+  for (int i = 0; i < 3; ++i)
+    getline(fields, field[i], ':');
+
+  errorMessage = "Fault \"" + spec + "\" should be <cycle>:<register or address>:<bit>.";
+  if (!parseNumber(field[0], fault.cycle) || fault.cycle < 0)
+    return false;
+
+  if (findRegisterIndex(field[1]) >= 0)
+    fault.target = FAULT_REGISTER + findRegisterIndex(field[1]);
+  else if (parseAddress(field[1], address))
+    fault.target = address;
+  else
+    return false;
+
+  if (!parseNumber(field[2], number) || number < 0 || number > 7)
+    return false;
+  fault.bit = number;
+  return true;
+}
+
+// Every bit a random fault may flip, from "ram,a,b,sum,ir,flags"...
+bool getFaultBits(string targetList, vector<Fault> &bits, string &errorMessage) {
+  stringstream targets(targetList);
+  string       target;
+  Fault        fault;
+  fault.cycle = 0;
+
+  while (getline(targets, target, ',')) {
+    for (unsigned int i = 0; i < target.length(); ++i)
+      target[i] = tolower(target[i]);
+
+    vector<int> registers;
+    if (target == "ram") {
+      for (fault.target = 0; fault.target < 256; ++fault.target)
+        for (fault.bit = 0; fault.bit < 8; ++fault.bit)
+          bits.push_back(fault);
+      continue;
+    }
+    if (target == "flags") {
+      registers.push_back(findRegisterIndex("ZF"));
+      registers.push_back(findRegisterIndex("CF"));
+    }
+    else if (findRegisterIndex(target) >= 0)
+      registers.push_back(findRegisterIndex(target));
+    else {
+      errorMessage = "Unknown fault target \"" + target + "\".";
+      return false;
+    }
+
+    // Flags only have one bit.
+    for (unsigned int i = 0; i < registers.size(); ++i) {
+      fault.target = FAULT_REGISTER + registers[i];
+      string name  = MachineRegisterNames[registers[i]];
+      for (fault.bit = 0; fault.bit < ((name == "ZF" || name == "CF") ? 1 : 8); ++fault.bit)
+        bits.push_back(fault);
+    }
   }
 
-  byteLine.erase(0, 11);
+  if (bits.empty()) {
+    errorMessage = "No fault target given.";
+    return false;
+  }
   return true;
 }
 
-uint8_t extractData(string byteLine) {
-  uint8_t argumentData = 0;
-  for (int i = 0; i < 8; ++i) {
-    if (byteLine[i] == '1') 
-      argumentData |= (1 << (7 - i));
+void injectFault(const Fault &fault) {
+  uint8_t* registers[] = { &MemRegister, &ARegister, &BRegister, &SumRegister, &Instruction,
+                           &ProgramCounter, &OutRegister, &ZeroFlag, &CarryFlag };
+  if (fault.target < FAULT_REGISTER)
+    RAMContent[fault.target] ^= 1 << fault.bit;
+  else
+    *registers[fault.target - FAULT_REGISTER] ^= 1 << fault.bit;
+}
+
+int getFaultOutcome() {
+  if (StopReason == GoldenStop && OutHistory == GoldenOutputs)
+    return 0;
+  if (StopReason == "unknown")
+    return 3;
+  if (StopReason == "budget" && GoldenStop != "budget")
+    return 2;
+  return 1;
+}
+
+// Worker only. Faults are separated by spaces, their fields by commas.
+string runFaultChunk(const vector<Fault> &faults, int chunk) {
+  string line;
+  for (int i = chunk * FAULT_CHUNK; i < min((int)faults.size(), (chunk + 1) * FAULT_CHUNK); ++i) {
+    advanceMachine(FaultGolden, faults[i].cycle);
+    size_t outputCount = OutHistory.size();
+
+    loadMachine(FaultGolden);
+    injectFault(faults[i]);
+    CycleBudget = FaultBudget;
+    while (ProgramRun)
+      runInstruction(MainMachine);
+
+    line += (line == "" ? "" : " ") + to_string(getFaultOutcome())
+          + "," + StopReason + "," + to_string(cycleCounting) + "," + toHexString(OutHistory.data(), OutHistory.size());
+    OutHistory.resize(outputCount);
   }
-  return argumentData;
+  return line;
 }
 
-bool checkData(string filename) {
-  cout << "[debug] Checking validity of file..." << endl;
+bool decodeFaultResult(string text, FaultResult &result) {
+  stringstream fields(text);
+  string       field[4];
+  for (int i = 0; i < 4; ++i)
+    getline(fields, field[i], ',');
 
-  fstream byteFile;             // open machine code file
-  string  byteLine;             // line of byte code
+  result.outcome = atoi(field[0].c_str());
+  result.stop    = field[1];
+  result.cycles  = atoi(field[2].c_str());
+  result.outputs.resize(field[3].length() / 2);
+  return field[1] != "" && result.outcome >= 0 && result.outcome < 4
+      && (result.outputs.empty() || fromHexString(field[3], &result.outputs[0], result.outputs.size()));
+}
 
-  byteFile.open(filename, fstream::in);
-  if (!byteFile) {
-    cout << "[error] Cannot open code file \"" << filename << "\"!" << endl;
-    return false;
+void writeFaultReport(ostream &report, bool isCSV, const vector<Fault> &faults, const vector<FaultResult> &results) {
+  if (isCSV)
+    report << "cycle,target,bit,outcome,stop,cycles,outputs" << endl;
+  else {
+    report << "{" << endl;
+    report << "  \"golden\": { \"stop\": " << quoteJSON(GoldenStop) << ", \"cycles\": " << FaultGolden.cycleCounting
+           << ", \"outputs\": [" << joinOutputs(GoldenOutputs, ", ") << "] }," << endl;
+    report << "  \"faults\": [" << endl;
   }
 
-  for (int i = 0; i < 256; ++i) {
-    if (byteFile.eof()) {
-      cout << "[error] Insufficient amount of byte code!" << endl;
-      return false;
+  for (unsigned int i = 0; i < faults.size(); ++i) {
+    const FaultResult &result = results[i];
+    string outcome = (result.outcome >= 0) ? FaultOutcomeNames[result.outcome] : "lost";
+    if (isCSV) {
+      report << faults[i].cycle << "," << getFaultTargetName(faults[i].target) << ","
+             << unsigned(faults[i].bit) << "," << outcome << "," << result.stop << "," << result.cycles << ","
+             << joinOutputs(result.outputs, " ") << endl;
+      continue;
     }
+    report << "    { \"cycle\": "  << faults[i].cycle
+           << ", \"target\": "     << quoteJSON(getFaultTargetName(faults[i].target))
+           << ", \"bit\": "        << unsigned(faults[i].bit)
+           << ", \"outcome\": "    << quoteJSON(outcome)
+           << ", \"stop\": "       << quoteJSON(result.stop)
+           << ", \"cycles\": "     << result.cycles
+           << ", \"outputs\": ["   << joinOutputs(result.outputs, ", ") << "] }"
+           << (i + 1 < faults.size() ? "," : "") << endl;
+  }
 
-    getline(byteFile, byteLine);
-    if (!checkByteLine(byteLine)) {
-      cout << "[error] Wrong format for the file!" << endl;
-      return false;
+  if (!isCSV) {
+    report << "  ]" << endl;
+    report << "}" << endl;
+  }
+}
+
+void printFaultSummary(const vector<Fault> &faults, const vector<FaultResult> &results) {
+  // All of RAM in one row, then one per register hit & the total.
+  vector<string> rowNames(1, "RAM");
+  map<string, vector<int> > rows;
+  for (int i = 0; i < 9; ++i)
+    rowNames.push_back(MachineRegisterNames[i]);
+  rowNames.push_back("total");
+  for (unsigned int i = 0; i < rowNames.size(); ++i)
+    rows[rowNames[i]].assign(5, 0);
+
+  for (unsigned int i = 0; i < faults.size(); ++i) {
+    string name    = (faults[i].target < FAULT_REGISTER) ? "RAM" : getFaultTargetName(faults[i].target);
+    int    outcome = results[i].outcome >= 0 ? results[i].outcome : 4;
+    rows[name][outcome]++;
+    rows["total"][outcome]++;
+  }
+
+  char line[128];
+  snprintf(line, sizeof(line), "    %-6s %8s %8s %8s %8s", "", "same", "wrong", "hang", "crash");
+  cout << line << (rows["total"][4] > 0 ? "     lost" : "") << endl;
+  for (unsigned int i = 0; i < rowNames.size(); ++i) {
+    vector<int> &row = rows[rowNames[i]];
+    if (row[0] + row[1] + row[2] + row[3] + row[4] == 0)
+      continue;
+    snprintf(line, sizeof(line), "    %-6s %8d %8d %8d %8d", rowNames[i].c_str(), row[0], row[1], row[2], row[3]);
+    cout << line;
+    if (rows["total"][4] > 0)
+      cout << " " << setw(8) << row[4];
+    cout << endl;
+  }
+}
+
+// Returns 0, or -5 if the campaign could not be run.
+int runFaults() {
+  vector<Fault> faults;
+  vector<Fault> bits;
+  string        errorMessage;
+
+  for (unsigned int i = 0; i < ChosenFaults.size(); ++i) {
+    Fault fault;
+    if (!parseFault(ChosenFaults[i], fault, errorMessage)) {
+      cout << "[error] " << errorMessage << endl;
+      return -5;
     }
+    faults.push_back(fault);
+  }
+  if (FaultCount > 0 && !getFaultBits(FaultTargets, bits, errorMessage)) {
+    cout << "[error] " << errorMessage << endl;
+    return -5;
+  }
 
-    // Get data, simple
-    RAMContent[i] = extractData(byteLine);
+  // The golden run
+  chrono::steady_clock::time_point start = chrono::steady_clock::now();
+  BatchMode = true;
+  resetMachine();
+  run();
+  GoldenOutputs = OutHistory;
+  GoldenStop    = StopReason;
+  FaultBudget   = cycleCounting;
+  if (GoldenStop != "budget")
+    FaultBudget = (int)min((long long)CycleBudget, 2LL * cycleCounting + 1000);
+
+  cout << "[faults] golden run: " << GoldenStop << " after " << cycleCounting << " cycles, outputs:";
+  for (unsigned int i = 0; i < GoldenOutputs.size() && i < 16; ++i)
+    cout << " " << unsigned(GoldenOutputs[i]);
+  cout << (GoldenOutputs.size() > 16 ? " ..." : "") << endl;
+  cout << "[faults] faulty runs stop after " << FaultBudget << " cycles." << endl;
+
+  for (unsigned int i = 0; i < faults.size(); ++i) {
+    if (faults[i].cycle >= cycleCounting) {
+      cout << "[error] Fault \"" << ChosenFaults[i] << "\" comes after the golden run ended." << endl;
+      return -5;
+    }
   }
 
-  cout << "[debug] File ready to run." << endl;
+  mt19937_64 random(FaultSeed);
+  for (int i = 0; i < FaultCount; ++i) {
+    Fault fault = bits[uniform_int_distribution<size_t>(0, bits.size() - 1)(random)];
+    fault.cycle = uniform_int_distribution<int>(0, max(0, cycleCounting - 1))(random);
+    faults.push_back(fault);
+  }
+  stable_sort(faults.begin(), faults.end(), [](const Fault &a, const Fault &b) { return a.cycle < b.cycle; });
+
+  // Every worker starts from the machine before cycle 0.
+  resetMachine();
+  saveMachine(FaultGolden);
+
+  vector<string> lines;
+  int chunkCount  = (faults.size() + FAULT_CHUNK - 1) / FAULT_CHUNK;
+  int workerCount = runWorkers(chunkCount, [&faults](int chunk) { return runFaultChunk(faults, chunk); }, lines);
+  if (workerCount == 0)
+    return -5;
+
+  // Faults of a chunk whose worker died are "lost".
+  vector<FaultResult> results(faults.size());
+  for (int chunk = 0; chunk < chunkCount; ++chunk) {
+    stringstream chunkResults(lines[chunk]);
+    string       text;
+    for (int i = chunk * FAULT_CHUNK; i < min((int)faults.size(), (chunk + 1) * FAULT_CHUNK); ++i) {
+      if (!(chunkResults >> text) || !decodeFaultResult(text, results[i])) {
+        results[i].outcome  = -1;
+        results[i].stop     = "";
+        results[i].cycles   = 0;
+        results[i].outputs.clear();
+      }
+    }
+  }
+
+  double milliseconds = chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now() - start).count() / 1000.0;
+  cout << "[faults] " << faults.size() << " faults on " << workerCount << " workers in " << milliseconds << " ms:" << endl;
+  printFaultSummary(faults, results);
+
+  if (ReportFileName != "") {
+    fstream report;
+    report.open(ReportFileName, fstream::out);
+    writeFaultReport(report, ReportFileName.length() > 4 && ReportFileName.substr(ReportFileName.length() - 4) == ".csv",
+                     faults, results);
+    report.close();
+    if (!report) {
+      cout << "[error] Cannot write report \"" << ReportFileName << "\"." << endl;
+      return -5;
+    }
+  }
+  return 0;
+}
+
+#else
+int runFaults() {
+  cout << "[error] Fault injection needs a unix system." << endl;
+  return -5;
+}
+#endif
+
+////////////////////// Switching activity /////////////////////////////
+// "LDA", "LDI 3" for a short form, or "0xc0" for a byte that is no opcode
+string getOpcodeName(uint8_t opcode) {
+  if (!isKnownOpcode(opcode, ExtendedISA))
+    return "0x" + toHexString(&opcode, 1);
+  if (isShortForm(opcode, ExtendedISA))
+    return string(getMnemonic(opcode, ExtendedISA)) + " " + to_string(opcode & 0x0f);
+  return getMnemonic(opcode, ExtendedISA);
+}
+
+// The instruction at <address> as the program was loaded,
+// which is the line of the source it came from.
+string getInstructionText(uint8_t address) {
+  uint8_t opcode = InitialRAMContent[address];
+  string  text   = getOpcodeName(opcode);
+  if (hasOperand(opcode, ExtendedISA))
+    text += " " + to_string(InitialRAMContent[(uint8_t)(address + 1)]);
+  return text;
+}
+
+uint64_t getActivityTotal(const ActivityCounts &counts) {
+  uint64_t total = 0;
+  for (int i = 0; i < ACTIVITY_SIGNALS; ++i)
+    total += counts.toggles[i];
+  return total;
+}
+
+void writeActivityRow(ostream &report, bool isCSV, string kind, string address, string name,
+                      const ActivityCounts &counts, bool isLast) {
+  if (isCSV) {
+    report << kind << "," << address << "," << quoteCSV(name) << "," << counts.runs << ","
+           << counts.steps << "," << getActivityTotal(counts);
+    for (int i = 0; i < ACTIVITY_SIGNALS; ++i)
+      report << "," << counts.toggles[i];
+    report << endl;
+    return;
+  }
+
+  report << "    { ";
+  if (address != "")
+    report << "\"address\": " << address << ", ";
+  report << "\"" << (address != "" ? "instruction" : "opcode") << "\": " << quoteJSON(name)
+         << ", \"runs\": "    << counts.runs
+         << ", \"steps\": "   << counts.steps
+         << ", \"toggles\": " << getActivityTotal(counts);
+  for (int i = 0; i < ACTIVITY_SIGNALS; ++i)
+    report << ", \"" << ActivityNames[i] << "\": " << counts.toggles[i];
+  report << " }" << (isLast ? "" : ",") << endl;
+}
+
+void writeActivityReport(ostream &report, bool isCSV, const ActivityCounts &totals) {
+  vector<int> addresses;
+  vector<int> opcodes;
+  for (int i = 0; i < 256; ++i) {
+    if (ActivityByAddress[i].steps > 0)
+      addresses.push_back(i);
+    if (ActivityByOpcode[i].steps > 0)
+      opcodes.push_back(i);
+  }
+
+  if (isCSV)
+    report << "kind,address,name,runs,steps,toggles,mar,a,b,sum,ir,pc,out,bus" << endl;
+  else {
+    report << "{" << endl;
+    report << "  \"cycles\": "  << cycleCounting << "," << endl;
+    report << "  \"toggles\": " << getActivityTotal(totals) << "," << endl;
+    report << "  \"signals\": {";
+    for (int i = 0; i < ACTIVITY_SIGNALS; ++i)
+      report << (i == 0 ? " " : ", ") << "\"" << ActivityNames[i] << "\": " << totals.toggles[i];
+    report << " }," << endl;
+    report << "  \"addresses\": [" << endl;
+  }
+
+  for (unsigned int i = 0; i < addresses.size(); ++i)
+    writeActivityRow(report, isCSV, "address", to_string(addresses[i]), getInstructionText(addresses[i]),
+                     ActivityByAddress[addresses[i]], i + 1 == addresses.size());
+
+  if (!isCSV) {
+    report << "  ]," << endl;
+    report << "  \"opcodes\": [" << endl;
+  }
+  for (unsigned int i = 0; i < opcodes.size(); ++i)
+    writeActivityRow(report, isCSV, "opcode", "", getOpcodeName(opcodes[i]),
+                     ActivityByOpcode[opcodes[i]], i + 1 == opcodes.size());
+
+  if (!isCSV) {
+    report << "  ]" << endl;
+    report << "}" << endl;
+  }
+}
+
+// After a batch run: the totals on the screen, the rest in the report.
+bool saveActivity() {
+  flushActivity(MainMachine);
+
+  ActivityCounts totals = ActivityCounts();
+  for (int i = 0; i < 256; ++i) {
+    totals.steps += ActivityByOpcode[i].steps;
+    for (int j = 0; j < ACTIVITY_SIGNALS; ++j)
+      totals.toggles[j] += ActivityByOpcode[i].toggles[j];
+  }
+
+  cout << "[activity] toggles: " << getActivityTotal(totals) << " in " << totals.steps << " micro-steps,";
+  for (int i = 0; i < ACTIVITY_SIGNALS; ++i) {
+    string name = ActivityNames[i];
+    transform(name.begin(), name.end(), name.begin(), ::toupper);
+    cout << " " << name << "=" << totals.toggles[i];
+  }
+  cout << endl;
+
+  fstream report;
+  report.open(ActivityFileName, fstream::out);
+  writeActivityReport(report, ActivityFileName.length() > 4 && ActivityFileName.substr(ActivityFileName.length() - 4) == ".csv",
+                      totals);
+  report.close();
+  if (!report) {
+    cout << "[error] Cannot write report \"" << ActivityFileName << "\"." << endl;
+    return false;
+  }
   return true;
 }
 
-bool initScreen() {
-  initscr();
+////////////////////// Taint tracking /////////////////////////////
+vector<int> getTaintAddresses(const TaintSet &taint) {
+  vector<int> addresses;
+  for (int i = 0; i < 256; ++i)
+    if (testAddressBit((uint64_t*)taint.bits, i))
+      addresses.push_back(i);
+  return addresses;
+}
 
-  cbreak();
-  noecho();
-  nodelay(stdscr, TRUE);
+// "1 (x) 9 (res) 16", named from the symbol map when there is one
+string getTaintText(const TaintSet &taint, map<int, string> &names) {
+  vector<int> addresses = getTaintAddresses(taint);
+  string      text;
+  for (unsigned int i = 0; i < addresses.size(); ++i) {
+    text += (i > 0 ? " " : "") + to_string(addresses[i]);
+    if (names.count(addresses[i]) > 0)
+      text += " (" + names[addresses[i]] + ")";
+  }
+  return text == "" ? "-" : text;
+}
 
-  scrollok(stdscr, TRUE);
+string getTaintJSON(const TaintSet &taint) {
+  vector<int> addresses = getTaintAddresses(taint);
+  string      text      = "[";
+  for (unsigned int i = 0; i < addresses.size(); ++i)
+    text += (i > 0 ? ", " : "") + to_string(addresses[i]);
+  return text + "]";
+}
+
+void writeTaintReport(ostream &report, bool isCSV, map<int, string> &names) {
+  if (isCSV) {
+    report << "output,value,kind,address,name" << endl;
+    for (unsigned int i = 0; i < TaintOutputs.size(); ++i) {
+      const TaintSet* taints[] = { &TaintOutputs[i].data, &TaintOutputs[i].control };
+      for (int kind = 0; kind < 2; ++kind) {
+        vector<int> addresses = getTaintAddresses(*taints[kind]);
+        for (unsigned int j = 0; j < addresses.size(); ++j)
+          report << i + 1 << "," << (int)OutHistory[i] << "," << (kind == 0 ? "data" : "control") << ","
+                 << addresses[j] << "," << quoteCSV(names.count(addresses[j]) > 0 ? names[addresses[j]] : "") << endl;
+      }
+    }
+    return;
+  }
+
+  report << "{" << endl;
+  report << "  \"names\": {";
+  string separator = " ";
+  for (map<int, string>::iterator name = names.begin(); name != names.end(); ++name) {
+    report << separator << "\"" << name->first << "\": " << quoteJSON(name->second);
+    separator = ", ";
+  }
+  report << " }," << endl;
+  report << "  \"outputs\": [" << endl;
+  for (unsigned int i = 0; i < TaintOutputs.size(); ++i)
+    report << "    { \"value\": "   << (int)OutHistory[i]
+           << ", \"data\": "    << getTaintJSON(TaintOutputs[i].data)
+           << ", \"control\": " << getTaintJSON(TaintOutputs[i].control)
+           << " }" << (i + 1 == TaintOutputs.size() ? "" : ",") << endl;
+  report << "  ]" << endl;
+  report << "}" << endl;
+}
+
+// After a batch run: where all the outputs come from on the
+// screen, output by output in the report.
+bool saveTaint(string symbolFileName) {
+  map<string, ProgramSymbol> symbols;
+  map<int, string>           names;
+  string                     ignored;
+  readSymbols(symbolFileName, symbols, ignored);
+  for (map<string, ProgramSymbol>::iterator symbol = symbols.begin(); symbol != symbols.end(); ++symbol)
+    if (symbol->second.isVariable) {
+      names[symbol->second.address] = symbol->first;
+      if (symbol->second.initializer >= 0)
+        names[symbol->second.initializer] = symbol->first;
+    }
+
+  // An OUT cut short by the budget never showed its value.
+  TaintOutputs.resize(min(TaintOutputs.size(), OutHistory.size()));
+  TaintSet data    = TaintSet();
+  TaintSet control = TaintSet();
+  for (unsigned int i = 0; i < TaintOutputs.size(); ++i) {
+    mergeTaint(data,    TaintOutputs[i].data);
+    mergeTaint(control, TaintOutputs[i].control);
+  }
+  cout << "[taint] data: "    << getTaintText(data, names)    << endl;
+  cout << "[taint] control: " << getTaintText(control, names) << endl;
+
+  fstream report;
+  report.open(TaintFileName, fstream::out);
+  writeTaintReport(report, TaintFileName.length() > 4 && TaintFileName.substr(TaintFileName.length() - 4) == ".csv", names);
+  report.close();
+  if (!report) {
+    cout << "[error] Cannot write report \"" << TaintFileName << "\"." << endl;
+    return false;
+  }
   return true;
 }
 
 ////////////////////// Main ///////////////////////////////////
 
+#ifndef LIBRARY
+// Only wakes the screen thread up, which stops the machine.
 void checkInterupt(int signal) {
-  // Stops the program.
-  ProgramRun = 0;
-  cout << endl;
-  cout << "[debug] Program abruptly exit after " << cycleCounting << " cycles." << endl;
+  Interrupted = 1;
+  wakeScreen();
 }
 
 void closeProgram() {
   #if defined(WIN32) && !defined(__unix__)
     cout << endl;
-    cout << "[debug] Program finished after " << cycleCounting << " cycles." << endl;
+    if (Interrupted)
+      cout << "[debug] Program abruptly exit after " << cycleCounting << " cycles." << endl;
+    else
+      cout << "[debug] Program finished after " << cycleCounting << " cycles." << endl;
   #elif defined(__unix__) && !defined(WIN32)
+    if (Interrupted) {
+      endwin();
+      cout << "[debug] Program abruptly exit after " << cycleCounting << " cycles." << endl;
+      return;
+    }
+
     printw("\n");
     printw("Program finished after %d cycles.\n", cycleCounting);
     printw("Press anykey to quit...\n");
-    while (!kbhit()) 
-      usleep(100000);
+    refresh();
+    timeout(-1);
+    getch();
     endwin();
   #endif
 }
+#endif
+
+#ifdef PROFILE
+void printProfileTimer(string name, const ProfileTimer &timer, bool isLast) {
+  cerr << "    \"" << name << "\": { \"calls\": " << timer.calls
+       << ", \"ms\": " << timer.nanoseconds / 1000000.0 << " }" << (isLast ? "" : ",") << endl;
+}
+
+// Runs at exit, whichever way the program ends.
+void printProfile() {
+  double wallTime = chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - ProfileStart).count() / 1000000.0;
+
+  cerr << "{" << endl;
+  cerr << "  \"wall_ms\": "     << wallTime          << "," << endl;
+  cerr << "  \"cycles\": "      << cycleCounting     << "," << endl;
+  cerr << "  \"micro_steps\": " << ProfileMicroSteps << "," << endl;
+  cerr << "  \"commands\": "    << ProfileCommands   << "," << endl;
+
+  // Bytes that are not an opcode are listed in hex.
+  cerr << "  \"opcodes\": {";
+  string separator = " ";
+  for (int i = 0; i < 256; ++i) {
+    if (ProfileOpcodes[i] == 0)
+      continue;
+
+    cerr << separator << "\"" << getOpcodeName(i) << "\": " << ProfileOpcodes[i];
+    separator = ", ";
+  }
+  cerr << " }," << endl;
+
+  cerr << "  \"timers\": {" << endl;
+  printProfileTimer("publish", ProfilePublish, false);
+  printProfileTimer("sleep",   ProfileSleep,   false);
+  printProfileTimer("wait",    ProfileWait,    false);
+  printProfileTimer("display", ProfileDisplay, false);
+  printProfileTimer("refresh", ProfileRefresh, false);
+  printProfileTimer("input",   ProfileInput,   true);
+  cerr << "  }" << endl;
+  cerr << "}" << endl;
+}
+#endif
+
+#ifdef FUZZ
+#ifndef FUZZ_CYCLES
+  #define FUZZ_CYCLES 1000
+#endif
+
+/* libFuzzer entry, replacing main():
+     clang++ -g -O1 -DFUZZ -fsanitize=fuzzer,address,undefined run.cpp -o run-fuzz -lncurses -pthread
+   Every input is a memory image (zeros after its end) run for
+   FUZZ_CYCLES cycles, with the extended ISA when a 257th byte is odd. The machine is then reset & the image run again,
+   both runs must end the same or cached results & resets are wrong,
+   and the same as the constexpr machine or one of them is wrong. */
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size) {
+  BatchMode   = true;
+  CycleBudget = FUZZ_CYCLES;
+  ExtendedISA = size > 256 && (data[256] & 1);
+
+  memset(InitialRAMContent, 0, sizeof(InitialRAMContent));
+  memcpy(InitialRAMContent, data, min(size, sizeof(InitialRAMContent)));
+  memcpy(RAMContent, InitialRAMContent, sizeof(RAMContent));
+  resetMachine();
+  run();
+
+  uint8_t         firstRAM[256];
+  vector<uint8_t> firstOutputs  = OutHistory;
+  string          firstStop     = StopReason;
+  int             firstCycles   = cycleCounting;
+  uint8_t         firstRegisters[] = { MemRegister, ARegister, BRegister, SumRegister, Instruction,
+                                       ProgramCounter, OutRegister, ZeroFlag, CarryFlag };
+  memcpy(firstRAM, RAMContent, sizeof(firstRAM));
+
+  resetMachine();
+  if (memcmp(RAMContent, InitialRAMContent, sizeof(RAMContent)) != 0)
+    abort();
+  run();
+
+  uint8_t registers[] = { MemRegister, ARegister, BRegister, SumRegister, Instruction,
+                          ProgramCounter, OutRegister, ZeroFlag, CarryFlag };
+  if (cycleCounting != firstCycles || StopReason != firstStop || OutHistory != firstOutputs
+      || memcmp(registers, firstRegisters, sizeof(registers)) != 0
+      || memcmp(RAMContent, firstRAM, sizeof(RAMContent)) != 0)
+    abort();
 
+  ConstMachine m = runConstMachine(InitialRAMContent, sizeof(InitialRAMContent), FUZZ_CYCLES, ExtendedISA);
+  uint8_t constRegisters[] = { m.MemRegister, m.ARegister, m.BRegister, m.SumRegister, m.Instruction,
+                               m.ProgramCounter, m.OutRegister, m.ZeroFlag, m.CarryFlag };
+  const char* constStops[] = { "", "hlt", "unknown", "budget" };
+  if (m.cycleCounting != firstCycles || firstStop != constStops[m.stop]
+      || m.outputCount != (int)firstOutputs.size()
+      || memcmp(firstOutputs.data(), m.outputs, min(firstOutputs.size(), sizeof(m.outputs))) != 0
+      || memcmp(constRegisters, firstRegisters, sizeof(constRegisters)) != 0
+      || memcmp(m.RAMContent, firstRAM, sizeof(firstRAM)) != 0)
+    abort();
+  return 0;
+}
+#elif !defined(LIBRARY)
 int main(int argc, char* argv[]) {
-  if (!checkArgumentError(argc, argv)) 
+  #ifdef PROFILE
+    atexit(printProfile);
+  #endif
+
+  string fileName;
+  if (!parseArguments(argc, argv, fileName)) 
     return -1;
+
+  if (JobsFileName != "")
+    return runJobs();
   
-  if (!checkData(string(argv[1])))
+  if (!checkData(fileName))
+    return -2;
+
+  map<string, ProgramSymbol> symbols;
+  string                     errorMessage;
+  if (!applyOverrides(Overrides, symbols, SymbolFileName != "" ? SymbolFileName : getSymbolFileName(fileName), errorMessage)) {
+    cout << "[error] " << errorMessage << endl;
     return -2;
+  }
+
+  memcpy(InitialRAMContent, RAMContent, sizeof(RAMContent));
+
+  if (BatchMode) {
+    if (TaintMode)
+      resetTaint();
+    runBatch();
+    if (ActivityMode && !saveActivity())
+      return -5;
+    if (TaintMode && !saveTaint(SymbolFileName != "" ? SymbolFileName : getSymbolFileName(fileName)))
+      return -5;
+    return 0;
+  }
+
+  if (ServerMode)
+    return runServer() ? 0 : -4;
+
+  if (FaultCount > 0 || !ChosenFaults.empty())
+    return runFaults();
+
+  if (DiffFileName != "") {
+    if (!checkData(DiffFileName))
+      return -2;
+    runDiff();
+    return 0;
+  }
 
   if (!initScreen())
     return -3;
   
-  #if defined(WIN32) && !defined(__unix__)
-    signal(SIGINT, checkInterupt);
-  #endif
+  signal(SIGINT, checkInterupt);
 
-  run();
+  // Nothing is drawn before the machine publishes itself.
+  initRegisters();
+  publishSnapshot();
+
+  thread machineThread(runMachine);
+  runScreen();
+  machineThread.join();
   closeProgram();
 }
+#endif
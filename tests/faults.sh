@@ -0,0 +1,25 @@
+#!/bin/sh
+# Faults land right after the micro-step of their cycle, so flipping
+# IR, SUM or MAR in the middle of an instruction changes what
+# MultiplySlow prints. Run from the top of the tree once ./parser and
+# ./run are built (see Compiling in README.md).
+
+set -e
+REPORT=$(mktemp --suffix=.csv)
+trap 'rm -f "$REPORT"' EXIT
+
+./parser example-su-asms/MultiplySlow.su > /dev/null
+./run example-su-asms/MultiplySlow.out --workers 1 --report "$REPORT" \
+      --fault 618:ir:4 --fault 587:sum:5 --fault 615:mar:3 > /dev/null
+
+# cycle,target,bit,outcome,stop,cycles,outputs
+EXPECTED="587,SUM,5,wrong,hlt,621,193
+615,MAR,3,wrong,hlt,621,0
+618,IR,4,wrong,hlt,618,"
+
+if [ "$(tail -n +2 "$REPORT")" != "$EXPECTED" ]; then
+  echo "[error] Unexpected fault outcomes:"
+  cat "$REPORT"
+  exit 1
+fi
+echo "[faults] IR, SUM and MAR faults change the output."